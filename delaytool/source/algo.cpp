@@ -4,6 +4,9 @@
 #include <cmath>
 #include <algorithm>
 #include "algo.h"
+#include "threadpool.h"
+#include "scheduler.h"
+#include "stats.h"
 
 bool operator==(Error::ErrorType lhs, const Error& rhs) {
     return lhs == rhs.type;
@@ -46,6 +49,11 @@ std::vector<Port*> Device::getAllPorts() const {
     return res;
 }
 
+void Device::releaseArena() {
+    mapPool.release();
+    arena.release();
+}
+
 std::vector<Port*> Device::getAllOutPortsIn() const {
     std::vector<Port*> res;
     res.reserve(ports.size());
@@ -81,29 +89,43 @@ std::vector<int> Device::getAllOutPortPseudoIds() const {
     return res;
 }
 
-bool Device::hasVlinks(int in_port_id, int out_port_pseudo_id) const {
-    auto in_port = getPort(in_port_id);
-    auto out_port_in = fromOutPortByPseudoId(out_port_pseudo_id);
-    for(auto vnode: in_port->getAllVnodes()) {
-        if(vnode->selectNext(out_port_in->id) != nullptr) {
-            return true;
+std::vector<Vnode*> Device::getHopVnodes() const {
+    std::vector<Vnode*> res;
+    if(type == End) {
+        for(auto vl: sourceFor) {
+            res.push_back(vl->src.get());
         }
+        return res;
     }
-    return false;
-}
-
-std::vector<Vnode*> Device::getVlinks(int in_port_id, int out_port_pseudo_id) const {
-    auto in_port = getPort(in_port_id);
-    auto out_port_in = fromOutPortByPseudoId(out_port_pseudo_id);
-    std::vector<Vnode*> res;
-    for(auto vnode: in_port->getAllVnodes()) {
-        if(vnode->selectNext(out_port_in->id) != nullptr) {
+    for(const auto& pair: ports) {
+        for(auto [_, vnode]: pair.second->vnodes) {
             res.push_back(vnode);
         }
     }
     return res;
 }
 
+void Device::buildVlinkIndex() {
+    edgeVlinks.clear();
+    for(auto in_port: getAllPorts()) {
+        for(auto vnode: in_port->getAllVnodes()) {
+            for(const auto& vnode_next_own: vnode->next) {
+                edgeVlinks[edgeKey(in_port->id, vnode_next_own->in->id)].push_back(vnode);
+            }
+        }
+    }
+}
+
+bool Device::hasVlinks(int in_port_id, int out_port_pseudo_id) const {
+    return edgeVlinks.find(edgeKey(in_port_id, out_port_pseudo_id)) != edgeVlinks.end();
+}
+
+const std::vector<Vnode*>& Device::getVlinks(int in_port_id, int out_port_pseudo_id) const {
+    static const std::vector<Vnode*> empty;
+    auto found = edgeVlinks.find(edgeKey(in_port_id, out_port_pseudo_id));
+    return found != edgeVlinks.end() ? found->second : empty;
+}
+
 Port::Port(Device* device, int id)
     : id(id), device(device)
 {
@@ -141,10 +163,11 @@ double Port::bwUsage() const {
 Vlink::Vlink(VlinkConfig* config, int id, int srcId, std::vector<std::vector<int>> paths,
     int bag, int smax, int smin, double jit0)
     : config(config), id(id), bag(bag), bagB(bag * config->linkRate),
-    smax(smax), smin(smin), jit0(jit0), jit0b(std::ceil(jit0 * config->linkRate))
+    smax(smax), smin(smin), jit0(jit0), jit0b(std::ceil(jit0 * config->linkRate)),
+    lmax(smax), jitStart(NAN)
 {
     assert(!paths.empty());
-    src = std::make_unique<Vnode>(this, srcId);
+    src = makeArenaOwn<Vnode>(&arena, this, srcId);
     src->device->sourceFor.push_back(this);
 
     for(const auto& path: paths) {
@@ -156,10 +179,10 @@ Vlink::Vlink(VlinkConfig* config, int id, int srcId, std::vector<std::vector<int
             vnode = vnodeNext;
             vnodeNext = vnode->selectNext(path[++i]);
         }
-        // vnode is initialized if make_unique didnt returned nullptr
+        // vnode is initialized if makeArenaOwn didnt returned nullptr
         // now we need to add a new-made Vnode of input port path[i] to vnode->next vector
         for(size_t j = i; j < path.size(); j++) {
-            vnode->next.push_back(std::make_unique<Vnode>(this, path[j], vnode));
+            vnode->next.push_back(makeArenaOwn<Vnode>(&arena, this, path[j], vnode));
             vnode = vnode->next[vnode->next.size()-1].get();
         }
         // vnode is a leaf
@@ -172,7 +195,7 @@ Vnode::Vnode(Vlink* vlink, int portId, Vnode* prev)
       device(vlink->config->getDevice(vlink->config->portDevice(portId))),
       prev(prev),
       in(prev != nullptr ? device->getPort(portId) : nullptr),
-      outPrev(in != nullptr ? in->outPrev : -1), e2e()
+      next(&vlink->arena), outPrev(in != nullptr ? in->outPrev : -1), delayTasks(&device->arena), e2e()
 {
     in->vnodes[vl->id] = this;
 }
@@ -181,7 +204,7 @@ Vnode::Vnode(Vlink* vlink, int portId, Vnode* prev)
 Vnode::Vnode(Vlink* vlink, int srcId)
     : config(vlink->config), vl(vlink),
       device(vlink->config->getDevice(srcId)),
-      prev(nullptr), in(nullptr), outPrev(-1), e2e()
+      prev(nullptr), in(nullptr), next(&vlink->arena), outPrev(-1), delayTasks(&device->arena), e2e()
 {}
 
 Vnode* Vnode::selectNext(int portId) const {
@@ -211,57 +234,67 @@ void Vnode::_getAllDests(std::vector<const Vnode*> &vec) const {
 }
 
 Error VlinkConfig::buildTables(bool print) {
+    PhaseTimer timer(stats, AnalysisStats::BuildTables);
     if(scheme == "OQ") {
         return Error::Success;
     }
     assert(scheme == "CIOQ");
     for(auto device: getAllDevices()) {
-        if(device->type == Device::End) {
-            continue;
-        }
-        device->cioqMap = std::make_unique<CioqMap>(device);
-        generateTableBasic(device, n_queues, n_fabrics, print);
+        buildTable(device, print);
     }
     return Error::Success;
 }
 
-Error VlinkConfig::buildDelayTasks() {
-    if(scheme == "OQ") {
-        return _buildDelayTasksOQ();
-    } else {
-        assert(scheme == "CIOQ");
-        return _buildDelayTasksCIOQ();
+void VlinkConfig::buildTable(Device* device, bool print) {
+    if(device->type == Device::End) {
+        return;
+    }
+    device->cioqMap = std::make_unique<CioqMap>(device, n_queues, n_fabrics);
+    switch(cioqMapper) {
+        case CioqMapBasic:
+            generateTableBasic(device, n_queues, n_fabrics, print);
+            break;
+        case CioqMapBalanced:
+            generateTableBalanced(device, n_queues, n_fabrics, print);
+            break;
     }
 }
 
-Error VlinkConfig::_buildDelayTasksCIOQ() {
-    // create QRTA object for every independent component and every output port of every switch
+Error VlinkConfig::buildDelayTasks() {
+    assert(scheme == "OQ" || scheme == "CIOQ");
     for(auto device: getAllDevices()) {
-        if(device->type == Device::End) {
-            continue;
-        }
-        for(const auto& compOwn: device->cioqMap->comps) {
-            auto comp = compOwn.get();
-            device->qrtas[{Device::F, comp->id}] = std::make_unique<QRTA>(this);
+        createDeviceTasks(device);
+    }
+    for(auto device: getAllDevices()) {
+        linkDeviceTasks(device);
+    }
+    return Error::Success;
+}
+
+void VlinkConfig::createDeviceTasks(Device* device) {
+    // create QRTA object for every independent component (CIOQ) and every output port of a switch
+    if(device->type == Device::Switch) {
+        if(scheme == "CIOQ") {
+            for(const auto& compOwn: device->cioqMap->comps) {
+                device->qrtas[{Device::F, compOwn->id}] = makeArenaOwn<QRTA>(&device->arena, this);
+            }
         }
         for(const auto& out_port_in: device->getAllOutPortsIn()) {
-            int out_port_pseudo_id = out_port_in->id;
-            device->qrtas[{Device::P, out_port_pseudo_id}] = std::make_unique<QRTA>(this);
+            device->qrtas[{Device::P, out_port_in->id}] = makeArenaOwn<QRTA>(&device->arena, this);
         }
     }
 
     // create DelayTasks objects
-    for(auto device_next: getAllDevices()) {
-        for(auto port: device_next->getAllPorts()) {
-            for(auto vnode_next: port->getAllVnodes()) {
-                auto vnode = vnode_next->prev;
-                auto device = vnode->device;
-                // device is either a SOURCE end system or a switch
-                int out_pseudo_id = vnode_next->in->id;
-                QRTA* qrta_p = nullptr;
-                if(device->type == Device::Switch) {
-                    int in_id = vnode->in->id;
-                    assert(device->hasVlinks(in_id, out_pseudo_id));
+    for(auto vnode: device->getHopVnodes()) {
+        for(const auto& vnode_next_own: vnode->next) {
+            auto vnode_next = vnode_next_own.get();
+            // device is either a SOURCE end system or a switch
+            int out_pseudo_id = vnode_next->in->id;
+            QRTA* qrta_p = nullptr;
+            if(device->type == Device::Switch) {
+                int in_id = vnode->in->id;
+                assert(device->hasVlinks(in_id, out_pseudo_id));
+                if(scheme == "CIOQ") {
                     auto found1 = device->cioqMap->compsIndex.find({in_id, out_pseudo_id});
                     assert(found1 != device->cioqMap->compsIndex.end());
                     auto comp = found1->second;
@@ -269,254 +302,174 @@ Error VlinkConfig::_buildDelayTasksCIOQ() {
                     assert(found2 != device->qrtas.end());
                     QRTA* qrta_f = found2->second.get();
                     vnode->delayTasks[{Device::F, out_pseudo_id}] =
-                            std::make_unique<DelayTask>(vnode->vl, vnode_next, Device::F, qrta_f);
+                            makeArenaOwn<DelayTask>(&device->arena, vnode->vl, vnode_next, Device::F, qrta_f);
                     n_tasks++;
-//                    printf("created delayTask type F, vl %d, psout %d, device %d\n",
-//                           vnode->vl->id, out_pseudo_id, vnode->device->id);
-                    qrta_p = device->qrtas[{Device::P, out_pseudo_id}].get();
                 }
-                assert(vnode != nullptr);
-                assert(vnode->delayTasks.find({Device::P, out_pseudo_id}) == vnode->delayTasks.end());
-                vnode->delayTasks[{Device::P, out_pseudo_id}] =
-                        std::make_unique<DelayTask>(vnode->vl, vnode_next, Device::P, qrta_p);
-                n_tasks++;
-//                printf("created delayTask type P, vl %d, psout %d, device %d\n",
-//                       vnode->vl->id, out_pseudo_id, vnode->device->id);
+                qrta_p = device->qrtas[{Device::P, out_pseudo_id}].get();
             }
+            assert(vnode->delayTasks.find({Device::P, out_pseudo_id}) == vnode->delayTasks.end());
+            vnode->delayTasks[{Device::P, out_pseudo_id}] =
+                    makeArenaOwn<DelayTask>(&device->arena, vnode->vl, vnode_next, Device::P, qrta_p);
+            n_tasks++;
         }
     }
+}
 
-    // fill data dependencies between DelayTasks objects (in inputs fields)
-    for(auto device: getAllDevices()) {
-        for(auto port: device->getAllPorts()) {
-            for(auto vnode: port->getAllVnodes()) {
-                for(const auto& vnode_next_own: vnode->next) {
-                    // device is a switch
-                    assert(device->type == Device::Switch);
-                    auto vnode_next = vnode_next_own.get();
-                    int in_id = vnode->in->id;
-                    int out_pseudo_id = vnode_next->in->id;
-                    auto delayTask_f = vnode->delayTasks[{Device::F, out_pseudo_id}].get();
-                    auto comp = device->cioqMap->compsIndex[{in_id, out_pseudo_id}];
-                    // get all vl branches through this switch in this independent component
-                    for(auto [cur_in_id, cur_out_pseudo_id]: comp->edges) {
-                        for(auto cur_vnode: device->getVlinks(cur_in_id, cur_out_pseudo_id)) {
-                            assert(cur_vnode->in->id == cur_in_id); // DEBUG
-                            auto found = cur_vnode->prev->delayTasks.find({Device::P, cur_in_id});
-                            assert(found != cur_vnode->prev->delayTasks.end());
-                            auto curDelayTaskPrev = found->second.get();
-                            assert(curDelayTaskPrev != nullptr); // DEBUG
-                            delayTask_f->inputs[{curDelayTaskPrev->vl->id, cur_out_pseudo_id}] = curDelayTaskPrev;
-//                            printf("F-task vl %d, in %d, out %d, inputs[vl %d, out %d] = P-task vl %d, in %d, out %d\n",
-//                                   delayTask_f->vl->id, delayTask_f->in_id,
-//                                   vnode->config->connectedPort(delayTask_f->out_pseudo_id),
-//                                   curDelayTaskPrev->vl->id, vnode->config->connectedPort(cur_out_pseudo_id),
-//                                   curDelayTaskPrev->vl->id, curDelayTaskPrev->in_id,
-//                                   vnode->config->connectedPort(curDelayTaskPrev->out_pseudo_id)); // DEBUG;
-                        }
-                    }
-
-                    auto delayTask_p = vnode->delayTasks[{Device::P, out_pseudo_id}].get();
-                    auto out_port_in = device->fromOutPortByPseudoId(out_pseudo_id);
-                    // get all vls through this switch and its output port out_pseudo_id
-                    for(auto cur_vnode_next: out_port_in->getAllVnodes()) {
-                        auto cur_vnode = cur_vnode_next->prev;
-                        auto found = cur_vnode->delayTasks.find({Device::F, out_pseudo_id});
-                        assert(found != cur_vnode->delayTasks.end());
+void VlinkConfig::linkDeviceTasks(Device* device) {
+    // delay tasks of source end systems have no inputs
+    if(device->type == Device::End) {
+        return;
+    }
+    for(auto vnode: device->getHopVnodes()) {
+        for(const auto& vnode_next_own: vnode->next) {
+            auto vnode_next = vnode_next_own.get();
+            int in_id = vnode->in->id;
+            int out_pseudo_id = vnode_next->in->id;
+            auto delayTask_p = vnode->delayTasks[{Device::P, out_pseudo_id}].get();
+            auto out_port_in = device->fromOutPortByPseudoId(out_pseudo_id);
+            if(scheme == "CIOQ") {
+                auto delayTask_f = vnode->delayTasks[{Device::F, out_pseudo_id}].get();
+                auto comp = device->cioqMap->compsIndex[{in_id, out_pseudo_id}];
+                // get all vl branches through this switch in this independent component
+                for(auto [cur_in_id, cur_out_pseudo_id]: comp->edges) {
+                    for(auto cur_vnode: device->getVlinks(cur_in_id, cur_out_pseudo_id)) {
+                        assert(cur_vnode->in->id == cur_in_id); // DEBUG
+                        auto found = cur_vnode->prev->delayTasks.find({Device::P, cur_in_id});
+                        assert(found != cur_vnode->prev->delayTasks.end());
                         auto curDelayTaskPrev = found->second.get();
-                        assert(curDelayTaskPrev != nullptr); // DEBUG
-                        delayTask_p->inputs[{curDelayTaskPrev->vl->id, out_pseudo_id}] = curDelayTaskPrev;
-//                        printf("P-task vl %d, in %d, out %d, inputs[vl %d, out %d] = F-task vl %d, in %d, out %d\n",
-//                               delayTask_p->vl->id, delayTask_p->in_id,
-//                               vnode->config->connectedPort(delayTask_p->out_pseudo_id),
-//                               curDelayTaskPrev->vl->id, vnode->config->connectedPort(out_pseudo_id),
-//                               curDelayTaskPrev->vl->id, curDelayTaskPrev->in_id,
-//                               vnode->config->connectedPort(curDelayTaskPrev->out_pseudo_id)); // DEBUG;
+                        delayTask_f->inputs[{curDelayTaskPrev->vl->id, cur_out_pseudo_id}] = curDelayTaskPrev;
                     }
                 }
-            }
-        }
-    }
-//    printf("filled inputs of delaytasks!\n");
+                for(auto [_, curDelayTask]: delayTask_f->inputs) {
+                    curDelayTask->output_for[{delayTask_f->vl->id, delayTask_f->out_pseudo_id}] = delayTask_f;
+                }
 
-    // fill data dependencies between DelayTasks objects (in outputs fields)
-    for(auto device: getAllDevices()) {
-        for(auto port: device->getAllPorts()) {
-            for(auto vnode: port->getAllVnodes()) {
-                for(const auto& vnode_next_own: vnode->next) {
-                    // device is a switch
-                    assert(device->type == Device::Switch);
-                    auto vnode_next = vnode_next_own.get();
-                    int out_pseudo_id = vnode_next->in->id;
-                    auto delayTask_f = vnode->delayTasks[{Device::F, out_pseudo_id}].get();
-                    for(auto [_, curDelayTask]: delayTask_f->inputs) {
-                        curDelayTask->output_for[{delayTask_f->vl->id, delayTask_f->out_pseudo_id}] = delayTask_f;
-                    }
-                    auto delayTask_p = vnode->delayTasks[{Device::P, out_pseudo_id}].get();
-                    for(auto [_, curDelayTask]: delayTask_p->inputs) {
-                        curDelayTask->output_for[{delayTask_p->vl->id, delayTask_p->out_pseudo_id}] = delayTask_p;
-                    }
+                // get all vls through this switch and its output port out_pseudo_id
+                for(auto cur_vnode_next: out_port_in->getAllVnodes()) {
+                    auto cur_vnode = cur_vnode_next->prev;
+                    auto found = cur_vnode->delayTasks.find({Device::F, out_pseudo_id});
+                    assert(found != cur_vnode->delayTasks.end());
+                    auto curDelayTaskPrev = found->second.get();
+                    delayTask_p->inputs[{curDelayTaskPrev->vl->id, out_pseudo_id}] = curDelayTaskPrev;
+                }
+            } else {
+                // get all vls through this switch and its output port out_pseudo_id
+                for(auto cur_vnode_next: out_port_in->getAllVnodes()) {
+                    auto cur_vnode = cur_vnode_next->prev;
+                    auto cur_vnode_prev = cur_vnode->prev;
+                    assert(cur_vnode_prev != nullptr);
+                    auto found = cur_vnode_prev->delayTasks.find({Device::P, cur_vnode->in->id});
+                    assert(found != cur_vnode_prev->delayTasks.end());
+                    auto curDelayTaskPrev = found->second.get();
+                    delayTask_p->inputs[{curDelayTaskPrev->vl->id, out_pseudo_id}] = curDelayTaskPrev;
                 }
             }
+            for(auto [_, curDelayTask]: delayTask_p->inputs) {
+                curDelayTask->output_for[{delayTask_p->vl->id, delayTask_p->out_pseudo_id}] = delayTask_p;
+            }
         }
     }
-    return Error::Success;
 }
 
-Error VlinkConfig::_buildDelayTasksOQ() {
-    // create QRTA object for every output port of every switch
-    for(auto device: getAllDevices()) {
-        if(device->type == Device::End) {
-            continue;
-        }
-        for(const auto& out_port_in: device->getAllOutPortsIn()) {
-            int out_port_pseudo_id = out_port_in->id;
-            device->qrtas[{Device::P, out_port_pseudo_id}] = std::make_unique<QRTA>(this);
+void TaskGraph::build(const std::vector<DelayTask*>& tasks) {
+    size_t n = tasks.size();
+    outputStart.assign(n + 1, 0);
+    outputIds.clear();
+    for(size_t i = 0; i < n; i++) {
+        assert(tasks[i]->index == static_cast<int>(i));
+        for(auto [_, curDelayTask]: tasks[i]->output_for) {
+            outputIds.push_back(curDelayTask->index);
         }
+        outputStart[i+1] = static_cast<int>(outputIds.size());
     }
-
-    // create DelayTasks objects
-    for(auto device_next: getAllDevices()) {
-        for(auto port: device_next->getAllPorts()) {
-            for(auto vnode_next: port->getAllVnodes()) {
-                auto vnode = vnode_next->prev;
-                auto device = vnode->device;
-                // device is either a SOURCE end system or a switch
-                int out_pseudo_id = vnode_next->in->id;
-                QRTA* qrta_p = nullptr;
-                if(device->type == Device::Switch) {
-                    int in_id = vnode->in->id;
-                    assert(device->hasVlinks(in_id, out_pseudo_id));
-                    qrta_p = device->qrtas[{Device::P, out_pseudo_id}].get();
-                }
-                assert(vnode != nullptr);
-                assert(vnode->delayTasks.find({Device::P, out_pseudo_id}) == vnode->delayTasks.end());
-                vnode->delayTasks[{Device::P, out_pseudo_id}] =
-                        std::make_unique<DelayTask>(vnode->vl, vnode_next, Device::P, qrta_p);
-                n_tasks++;
-//                printf("created delayTask type P, vl %d, psout %d, device %d\n",
-//                       vnode->vl->id, out_pseudo_id, vnode->device->id);
-            }
-        }
+    // inputs are the reversed output_for edges, grouped by counting sort
+    inputStart.assign(n + 1, 0);
+    for(int j: outputIds) {
+        inputStart[j+1]++;
     }
-
-    // fill data dependencies between DelayTasks objects (in inputs fields)
-    for(auto device: getAllDevices()) {
-        for(auto port: device->getAllPorts()) {
-            for(auto vnode: port->getAllVnodes()) {
-                for(const auto& vnode_next_own: vnode->next) {
-                    // device is a switch
-                    assert(device->type == Device::Switch);
-                    auto vnode_next = vnode_next_own.get();
-                    int out_pseudo_id = vnode_next->in->id;
-                    auto delayTask_p = vnode->delayTasks[{Device::P, out_pseudo_id}].get();
-                    auto out_port_in = device->fromOutPortByPseudoId(out_pseudo_id);
-                    // get all vls through this switch and its output port out_pseudo_id
-                    for(auto cur_vnode_next: out_port_in->getAllVnodes()) {
-                        auto cur_vnode = cur_vnode_next->prev;
-                        auto cur_vnode_prev = cur_vnode->prev;
-                        assert(cur_vnode_prev != nullptr);
-                        auto found = cur_vnode_prev->delayTasks.find({Device::P, cur_vnode->in->id});
-                        assert(found != cur_vnode->delayTasks.end());
-                        auto curDelayTaskPrev = found->second.get();
-                        assert(curDelayTaskPrev != nullptr); // DEBUG
-                        delayTask_p->inputs[{curDelayTaskPrev->vl->id, out_pseudo_id}] = curDelayTaskPrev;
-//                        printf("P-task vl %d, in %d, out %d, inputs[vl %d, out %d] = P-task vl %d, in %d, out %d\n",
-//                               delayTask_p->vl->id, delayTask_p->in_id,
-//                               vnode->config->connectedPort(delayTask_p->out_pseudo_id),
-//                               curDelayTaskPrev->vl->id, vnode->config->connectedPort(out_pseudo_id),
-//                               curDelayTaskPrev->vl->id, curDelayTaskPrev->in_id,
-//                               vnode->config->connectedPort(curDelayTaskPrev->out_pseudo_id)); // DEBUG;
-                    }
-                }
-            }
+    for(size_t i = 0; i < n; i++) {
+        inputStart[i+1] += inputStart[i];
+    }
+    inputIds.assign(outputIds.size(), -1);
+    std::vector<int> filled(inputStart.begin(), inputStart.end() - 1);
+    for(size_t i = 0; i < n; i++) {
+        for(int j: outputsOf(static_cast<int>(i))) {
+            inputIds[filled[j]++] = static_cast<int>(i);
         }
     }
-//    printf("filled inputs of delaytasks!\n");
-
-    // fill data dependencies between DelayTasks objects (in outputs fields)
-    for(auto device: getAllDevices()) {
-        for(auto port: device->getAllPorts()) {
-            for(auto vnode: port->getAllVnodes()) {
-                for(const auto& vnode_next_own: vnode->next) {
-                    // device is a switch
-                    assert(device->type == Device::Switch);
-                    auto vnode_next = vnode_next_own.get();
-                    int out_pseudo_id = vnode_next->in->id;
-                    auto delayTask_p = vnode->delayTasks[{Device::P, out_pseudo_id}].get();
-                    for(auto [_, curDelayTask]: delayTask_p->inputs) {
-                        curDelayTask->output_for[{delayTask_p->vl->id, delayTask_p->out_pseudo_id}] = delayTask_p;
-                    }
-                }
+#ifndef NDEBUG
+    // DelayTask::inputs and output_for are consistent
+    for(size_t i = 0; i < n; i++) {
+        std::set<int> inputSet;
+        for(auto [_, curDelayTask]: tasks[i]->inputs) {
+            int j = curDelayTask->index;
+            if(j >= 0 && static_cast<size_t>(j) < n && tasks[j] == curDelayTask) {
+                inputSet.insert(j);
             }
         }
+        assert(inputSet.size() == inputsOf(static_cast<int>(i)).size());
+        for(int j: inputsOf(static_cast<int>(i))) {
+            assert(inputSet.count(j) == 1);
+        }
     }
-    return Error::Success;
+#endif
 }
 
 Error VlinkConfig::buildTasksOrder() {
-    // for all DelayTasks fill in_cycle values,
-    // build a set of delay tasks with false in_cycle values ("acyclic" tasks),
-    // and save the order of filling false in_cycle values (this will be the delay computation order among acyclic delay tasks).
-    std::vector<DelayTask*> tasksToVisit;
-    std::vector<DelayTask*> tasksToVisitNext;
-    std::set<std::tuple<int, int, Device::elem_t>> tasksToVisitSet;
-    size_t n_visited = 0;
-    std::vector<DelayTask*> acyclicTasksOrder;
-    std::set<std::tuple<int, int, Device::elem_t>> acyclicTasksSet;
-    // fetching all delay tasks without inputs
+    // collect all delay tasks, tasks of a vnode (F ones first) before tasks of its next vnodes
+    tasks.clear();
     for(auto vl: getAllVlinks()) {
-        auto vnode = vl->src.get();
-        for(const auto& vnode_next_own: vnode->next) {
-            auto vnode_next = vnode_next_own.get();
-            int out_pseudo_id = vnode_next->in->id;
-            auto delayTask = vnode->delayTasks[{Device::P, out_pseudo_id}].get();
-            assert(delayTask->inputs.empty());
-            tasksToVisitSet.insert(delayTask->id);
-            tasksToVisit.push_back(delayTask);
-        }
-    }
-    while(!tasksToVisit.empty()) {
-        size_t acyclic_size_frozen = acyclicTasksOrder.size();
-        for(auto delayTask: tasksToVisit) {
-            if(!delayTask->in_cycle) {
-                continue;
+        std::vector<Vnode*> vnodesToVisit = {vl->src.get()};
+        while(!vnodesToVisit.empty()) {
+            auto vnode = vnodesToVisit.back();
+            vnodesToVisit.pop_back();
+            for(const auto& [_, delayTaskOwn]: vnode->delayTasks) {
+                delayTaskOwn->index = static_cast<int>(tasks.size());
+                tasks.push_back(delayTaskOwn.get());
             }
-            bool has_inputs_in_cycle = false;
-            for(auto[_, curDelayTask]: delayTask->inputs) {
-                if(curDelayTask->in_cycle) {
-                    has_inputs_in_cycle = true;
-                    break;
-                }
-            }
-            if(!has_inputs_in_cycle) {
-                delayTask->in_cycle = false;
-                delayTask->cyclic_layer = 0;
-                acyclicTasksSet.insert(delayTask->id);
-                acyclicTasksOrder.push_back(delayTask);
+            for(const auto& vnode_next_own: vnode->next) {
+                vnodesToVisit.push_back(vnode_next_own.get());
             }
-            n_visited++;
         }
-        if(acyclicTasksOrder.size() == acyclic_size_frozen) {
-            break;
+    }
+    assert(tasks.size() == static_cast<uint64_t>(n_tasks));
+    return orderTasks();
+}
+
+Error VlinkConfig::orderTasks() {
+    for(auto delayTask: tasks) {
+        delayTask->in_cycle = true;
+        delayTask->cyclic_layer = -1;
+        delayTask->max_input_layer = -1;
+        delayTask->component = -1;
+    }
+    taskGraph.build(tasks);
+
+    // for all DelayTasks fill in_cycle values by Kahn's algorithm:
+    // a task is not in cycle ("acyclic" task) if all of its input tasks are acyclic.
+    // the order of finding acyclic tasks is the delay computation order among them.
+    std::vector<int> n_inputs(tasks.size(), 0); // number of input tasks not found acyclic yet
+    for(size_t i = 0; i < tasks.size(); i++) {
+        n_inputs[i] = static_cast<int>(taskGraph.inputsOf(static_cast<int>(i)).size());
+    }
+    acyclicTasksOrder.clear();
+    cyclicTasksOrder.clear();
+    cyclicComponents.clear();
+    for(auto delayTask: tasks) {
+        if(n_inputs[delayTask->index] == 0) {
+            assert(delayTask->inputs.empty() || tasks.size() < static_cast<uint64_t>(n_tasks));
+            acyclicTasksOrder.push_back(delayTask);
         }
-        for(auto delayTask: acyclicTasksOrder) {
-            for(auto[_, curDelayTask]: delayTask->output_for) {
-                if(curDelayTask->in_cycle) {
-                    tasksToVisitSet.insert(curDelayTask->id);
-                    tasksToVisitNext.push_back(curDelayTask);
-                }
+    }
+    for(size_t i = 0; i < acyclicTasksOrder.size(); i++) {
+        auto delayTask = acyclicTasksOrder[i];
+        delayTask->in_cycle = false;
+        delayTask->cyclic_layer = 0;
+        for(int j: taskGraph.outputsOf(delayTask->index)) {
+            if(--n_inputs[j] == 0) {
+                acyclicTasksOrder.push_back(tasks[j]);
             }
         }
-        tasksToVisit = std::move(tasksToVisitNext);
-        tasksToVisitNext.clear();
-    }
-    bool acyclic = tasksToVisitSet.size() <= acyclicTasksOrder.size();
-    if(!acyclic) {
-//        printf("%zu delay tasks found, but only %zu of them are not cyclic dependent!\n", n_tasks, acyclicTasksOrder.size());
-    } else {
-        assert(tasksToVisitSet.size() == acyclicTasksOrder.size());
-//        printf("%zu delay tasks found, no cyclic dependencies\n", n_tasks);
     }
 
 //    printf("acyclic tasks order:\n"); // DEBUG
@@ -526,39 +479,51 @@ Error VlinkConfig::buildTasksOrder() {
 //    }
 //    printf("\n"); // DEBUG/
 
-    this->tasks = tasksToVisit;
-    this->acyclicTasksOrder = acyclicTasksOrder;
-    if(acyclic) {
+    if(acyclicTasksOrder.size() == tasks.size()) {
+//        printf("%zu delay tasks found, no cyclic dependencies\n", n_tasks);
         return Error::Success;
     }
+//    printf("%zu delay tasks found, but only %zu of them are not cyclic dependent!\n", n_tasks, acyclicTasksOrder.size());
 
     // build a set of delay tasks with in_cycle=true ("cyclic" tasks), and label each cyclic task with
     // minimum hop distance to subgraph of acyclic tasks (cyclic_layer value)
     std::vector<DelayTask*> cyclicTasksToVisit;
-    std::set<std::tuple<int, int, Device::elem_t>> cyclicTasksToVisitSet;
+    std::vector<bool> cyclicTasksToVisitSet(tasks.size(), false); // by task index
     for(auto delayTask: acyclicTasksOrder) {
-        for(auto [_, curDelayTask]: delayTask->output_for) {
-            if(curDelayTask->in_cycle) {
-                if(cyclicTasksToVisitSet.find(curDelayTask->id) == cyclicTasksToVisitSet.end()) {
-                    cyclicTasksToVisitSet.insert(curDelayTask->id);
-                    cyclicTasksToVisit.push_back(curDelayTask);
+        for(int j: taskGraph.outputsOf(delayTask->index)) {
+            if(tasks[j]->in_cycle && !cyclicTasksToVisitSet[j]) {
+                cyclicTasksToVisitSet[j] = true;
+                cyclicTasksToVisit.push_back(tasks[j]);
+            }
+        }
+    }
+    // with a part of tasks, the ones with inputs outside of it are next to calculated tasks too
+    if(tasks.size() < static_cast<uint64_t>(n_tasks)) {
+        for(auto delayTask: tasks) {
+            if(!delayTask->in_cycle || cyclicTasksToVisitSet[delayTask->index]) {
+                continue;
+            }
+            for(auto [_, inputTask]: delayTask->inputs) {
+                int j = inputTask->index;
+                if(j < 0 || static_cast<size_t>(j) >= tasks.size() || tasks[j] != inputTask) {
+                    cyclicTasksToVisitSet[delayTask->index] = true;
+                    cyclicTasksToVisit.push_back(delayTask);
+                    break;
                 }
             }
         }
     }
     int cyclic_layer = 1;
-    n_visited = 0;
+    size_t n_visited = 0;
     while(n_visited < cyclicTasksToVisit.size()) {
         size_t size_frozen = cyclicTasksToVisit.size();
         for(size_t i = n_visited; i < size_frozen; i++) {
             auto delayTask = cyclicTasksToVisit[i];
             delayTask->cyclic_layer = cyclic_layer;
-            for(auto[_, curDelayTask]: delayTask->output_for) {
-                if(curDelayTask->in_cycle &&
-                    cyclicTasksToVisitSet.find(curDelayTask->id) == cyclicTasksToVisitSet.end())
-                {
-                    cyclicTasksToVisitSet.insert(curDelayTask->id);
-                    cyclicTasksToVisit.push_back(curDelayTask);
+            for(int j: taskGraph.outputsOf(delayTask->index)) {
+                if(tasks[j]->in_cycle && !cyclicTasksToVisitSet[j]) {
+                    cyclicTasksToVisitSet[j] = true;
+                    cyclicTasksToVisit.push_back(tasks[j]);
                 }
             }
             n_visited++;
@@ -567,15 +532,14 @@ Error VlinkConfig::buildTasksOrder() {
     }
 
     // assertions about acyclic and cyclic tasks sets
-    assert(cyclicTasksToVisitSet.size() == cyclicTasksToVisit.size());
 
     for(auto delayTask: acyclicTasksOrder) {
         assert(!delayTask->in_cycle);
         assert(delayTask->cyclic_layer == 0);
         bool has_cyclic_inputs = false;
-        for(auto [_, curDelayTask]: delayTask->inputs) {
-            assert(curDelayTask->cyclic_layer >= 0);
-            if(curDelayTask->in_cycle) {
+        for(int j: taskGraph.inputsOf(delayTask->index)) {
+            assert(tasks[j]->cyclic_layer >= 0);
+            if(tasks[j]->in_cycle) {
                 has_cyclic_inputs = true;
             }
         }
@@ -586,25 +550,24 @@ Error VlinkConfig::buildTasksOrder() {
         assert(delayTask->in_cycle);
         assert(delayTask->cyclic_layer > 0);
         bool has_cyclic_inputs = false;
-        for(auto [_, curDelayTask]: delayTask->inputs) {
-            assert(curDelayTask->cyclic_layer >= 0);
-            if(curDelayTask->in_cycle) {
+        for(int j: taskGraph.inputsOf(delayTask->index)) {
+            assert(tasks[j]->cyclic_layer >= 0);
+            if(tasks[j]->in_cycle) {
                 has_cyclic_inputs = true;
                 break;
             }
         }
         assert(has_cyclic_inputs);
     }
-    assert(acyclicTasksOrder.size() == acyclicTasksSet.size());
-    assert(cyclicTasksToVisitSet.size() + acyclicTasksSet.size() == static_cast<uint64_t>(n_tasks));
+    assert(cyclicTasksToVisit.size() + acyclicTasksOrder.size() == tasks.size());
 
     // label each cyclic task with maximum cyclic layer among its input tasks (max_input_layer),
     // and sort cyclic tasks by max_input_layer
     for(auto delayTask: cyclicTasksToVisit) {
         int max_layer = -1;
-        for(auto [_, curDelayTask]: delayTask->inputs) {
-            if(curDelayTask->cyclic_layer > max_layer) {
-                max_layer = curDelayTask->cyclic_layer;
+        for(int j: taskGraph.inputsOf(delayTask->index)) {
+            if(tasks[j]->cyclic_layer > max_layer) {
+                max_layer = tasks[j]->cyclic_layer;
             }
         }
         assert(max_layer > -1);
@@ -615,6 +578,8 @@ Error VlinkConfig::buildTasksOrder() {
 
     this->cyclicTasksOrder = cyclicTasksToVisit;
 
+    buildCyclicComponents();
+
 //    printf("acyclic tasks order:\n"); // DEBUG
 //    for(auto delayTask: this->cyclicTasksOrder) {
 //        printf("task vl=%d to %d (%s)\n",
@@ -632,117 +597,249 @@ Error VlinkConfig::buildTasksOrder() {
     return Error::Success;
 }
 
-Error VlinkConfig::calcDelays(bool print) {
-    buildDelayTasks();
-    buildTasksOrder();
+void VlinkConfig::buildCyclicComponents() {
+    // Tarjan's algorithm on the subgraph of cyclic tasks, without recursion.
+    // components are found in reverse topological order of the condensation.
+    std::vector<int> order(tasks.size(), -1); // discovery order by task index
+    std::vector<int> lowlink(tasks.size(), -1);
+    std::vector<bool> onStack(tasks.size(), false);
+    std::vector<int> stack;
+    std::vector<std::pair<int, const int*>> frames; // DFS frames: task and its next output task
+    int n_discovered = 0;
+    auto discover = [&](int i) {
+        order[i] = lowlink[i] = n_discovered++;
+        stack.push_back(i);
+        onStack[i] = true;
+        frames.emplace_back(i, taskGraph.outputsOf(i).begin());
+    };
+    for(auto root: cyclicTasksOrder) {
+        if(order[root->index] >= 0) {
+            continue;
+        }
+        discover(root->index);
+        while(!frames.empty()) {
+            auto [i, next] = frames.back();
+            if(next != taskGraph.outputsOf(i).end()) {
+                frames.back().second++;
+                int j = *next;
+                if(!tasks[j]->in_cycle) {
+                    continue;
+                }
+                if(order[j] < 0) {
+                    discover(j);
+                } else if(onStack[j]) {
+                    lowlink[i] = std::min(lowlink[i], order[j]);
+                }
+                continue;
+            }
+            frames.pop_back();
+            if(!frames.empty()) {
+                int parent = frames.back().first;
+                lowlink[parent] = std::min(lowlink[parent], lowlink[i]);
+            }
+            if(lowlink[i] == order[i]) {
+                std::vector<DelayTask*> component;
+                int member;
+                do {
+                    member = stack.back();
+                    stack.pop_back();
+                    onStack[member] = false;
+                    component.push_back(tasks[member]);
+                } while(member != i);
+                cyclicComponents.push_back(std::move(component));
+            }
+        }
+    }
+    std::reverse(cyclicComponents.begin(), cyclicComponents.end());
 
-    // calculate all final minimum delay estimates and preliminary maximum delay/jitter estimates
+    // order tasks in each component as in cyclicTasksOrder
+    for(size_t i = 0; i < cyclicComponents.size(); i++) {
+        for(auto delayTask: cyclicComponents[i]) {
+            delayTask->component = static_cast<int>(i);
+        }
+        cyclicComponents[i].clear();
+    }
+    for(auto delayTask: cyclicTasksOrder) {
+        cyclicComponents[delayTask->component].push_back(delayTask);
+    }
+
+#ifndef NDEBUG
+    // every input of a cyclic task is acyclic or belongs to the same or a preceding component
+    for(auto delayTask: cyclicTasksOrder) {
+        for(int j: taskGraph.inputsOf(delayTask->index)) {
+            assert(tasks[j]->component <= delayTask->component);
+        }
+    }
+#endif
+}
+
+void VlinkConfig::clearDelayTasks() {
     for(auto vl: getAllVlinks()) {
-        std::vector<Vnode*> vnodes_order; // breadth-first
-        auto vnode = vl->src.get();
-        vnodes_order.push_back(vnode);
-        size_t n_visited = 0;
-        while(n_visited < vnodes_order.size()) {
-            size_t size_frozen = vnodes_order.size();
-            for(size_t i = n_visited; i < size_frozen; i++) {
-                auto cur_vnode = vnodes_order[i];
-                for(const auto& vnode_next_own: cur_vnode->next) {
-                    auto vnode_next = vnode_next_own.get();
-                    vnodes_order.push_back(vnode_next);
-//                    printf("vl %d: add vnode in device %d to queue: size = %lu\n", vl->id, vnode_next->device->id, vnodes_order.size());
-                    std::vector<Device::elem_t> elem_types;
-                    if(scheme == "CIOQ") {
-                        elem_types = {Device::F, Device::P};
-                    } else if(scheme == "OQ") {
-                        elem_types = {Device::P};
-                    } else {
-                        assert(false);
-                    }
-                    for(auto elem: elem_types) {
-                        auto found = cur_vnode->delayTasks.find({elem, vnode_next->in->id});
-                        if(found != cur_vnode->delayTasks.end()) {
-                            auto delayTask = found->second.get();
-                            Error err = delayTask->calc_delay_init();
-                            if(err) {
-                                return err;
-                            }
-                            if(print) {
-//                                printf("init:   vl %d to port %d: dmin=%ld, prelim jit=%ld\n", vl->id, vnode_next->in->id,
-//                                       delayTask->delay.dmin(), delayTask->delay.jit()); // DEBUG
-                            }
-                        } else {
-                            if(elem == Device::F) {
-                                assert(cur_vnode->device->type == Device::End);
-                            } else {
-                                assert(false);
-                            }
-                        }
-                    }
-                }
-                n_visited++;
+        std::vector<Vnode*> stack = {vl->src.get()};
+        while(!stack.empty()) {
+            auto vnode = stack.back();
+            stack.pop_back();
+            vnode->delayTasks.clear();
+            for(const auto& next: vnode->next) {
+                stack.push_back(next.get());
             }
         }
     }
-//    printf("calculating MIN delays -- DONE\n");
+    for(auto device: getAllDevices()) {
+        device->qrtas.clear();
+        device->releaseArena();
+    }
+    n_tasks = 0;
+}
 
-    // calculating max delays that are computable in one iteration
-    for(auto delayTask: acyclicTasksOrder) {
-        delayTask->get_input_data();
-        Error err = delayTask->calc_delay_max();
+void VlinkConfig::addVlink(VlinkOwn vl) {
+    assert(vlinks.find(vl->id) == vlinks.end());
+    std::set<Device*> vlDevices;
+    std::vector<Vnode*> stack = {vl->src.get()};
+    while(!stack.empty()) {
+        auto vnode = stack.back();
+        stack.pop_back();
+        vlDevices.insert(vnode->device);
+        for(const auto& next: vnode->next) {
+            stack.push_back(next.get());
+        }
+    }
+    vlinks[vl->id] = std::move(vl);
+    for(auto device: vlDevices) {
+        device->buildVlinkIndex();
+    }
+}
+
+void VlinkConfig::removeVlink(int id) {
+    auto found = vlinks.find(id);
+    assert(found != vlinks.end());
+    Vlink* vl = found->second.get();
+    std::set<Device*> vlDevices;
+    std::vector<Vnode*> stack = {vl->src.get()};
+    while(!stack.empty()) {
+        auto vnode = stack.back();
+        stack.pop_back();
+        vlDevices.insert(vnode->device);
+        if(vnode->in != nullptr) {
+            vnode->in->vnodes.erase(id);
+        }
+        for(const auto& next: vnode->next) {
+            stack.push_back(next.get());
+        }
+    }
+    auto& sourceFor = vl->src->device->sourceFor;
+    sourceFor.erase(std::remove(sourceFor.begin(), sourceFor.end(), vl), sourceFor.end());
+    vlinks.erase(found);
+    for(auto device: vlDevices) {
+        device->buildVlinkIndex();
+    }
+}
+
+Error VlinkConfig::calcDelays(bool print, ResultSink* sink) {
+    PhaseTimer buildTimer(stats, AnalysisStats::BuildDelayTasks);
+    clearDelayTasks();
+    buildDelayTasks();
+    buildTimer.stop();
+    PhaseTimer orderTimer(stats, AnalysisStats::BuildTasksOrder);
+    buildTasksOrder();
+    orderTimer.stop();
+    return calcTasks(print, sink);
+}
+
+Error VlinkConfig::recalcDelays(bool print, ResultSink* sink) {
+    assert(tasks.size() == static_cast<size_t>(n_tasks));
+    for(auto device: getAllDevices()) {
+        for(const auto& [_, qrta]: device->qrtas) {
+            qrta->clear_bp();
+        }
+    }
+    return calcTasks(print, sink);
+}
+
+Error VlinkConfig::calcTasksOf(std::vector<DelayTask*> subset, bool print, ResultSink* sink) {
+    // the input task of the same VL (on the previous hop, or the F task of the same hop) goes first
+    std::vector<std::pair<int, DelayTask*>> byHop;
+    for(auto delayTask: subset) {
+        int hop = 0;
+        for(auto vnode = delayTask->vnode; vnode->prev != nullptr; vnode = vnode->prev) {
+            hop++;
+        }
+        byHop.emplace_back(2 * hop + (delayTask->elem == Device::P), delayTask);
+    }
+    std::stable_sort(byHop.begin(), byHop.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+    tasks.clear();
+    for(auto [_, delayTask]: byHop) {
+        delayTask->index = static_cast<int>(tasks.size());
+        tasks.push_back(delayTask);
+    }
+    PhaseTimer orderTimer(stats, AnalysisStats::BuildTasksOrder);
+    orderTasks();
+    orderTimer.stop();
+    return calcTasks(print, sink);
+}
+
+Error VlinkConfig::calcTasks(bool print, ResultSink* sink) {
+    PhaseTimer acyclicTimer(stats, AnalysisStats::Acyclic);
+    bool partial = tasks.size() < static_cast<size_t>(n_tasks);
+    auto isCalculated = [this](const DelayTask* delayTask) {
+        int i = delayTask->index;
+        return i >= 0 && static_cast<size_t>(i) < tasks.size() && tasks[i] == delayTask;
+    };
+
+    // calculate all final minimum delay estimates and preliminary maximum delay/jitter estimates
+    for(auto delayTask: tasks) {
+        Error err = delayTask->calc_delay_init();
         if(err) {
             return err;
         }
-        delayTask->iter++;
-//        if(print) {
-//            printf("acyclic: vl %d to port %d (%s): dmin=%ld, prelim jit=%ld\n", delayTask->vl->id, delayTask->out_pseudo_id,
-//                   delayTask->elem == Device::F ? "F" : "P", delayTask->delay.dmin(), delayTask->delay.jit());
-//        }
     }
+//    printf("calculating MIN delays -- DONE\n");
+
+    // calculating max delays that are computable in one iteration,
+    // in parallel if n_threads > 1
+    ThreadPool pool(n_threads);
+    DataflowScheduler scheduler(taskGraph, tasks, pool);
+    Error err = scheduler.run(acyclicTasksOrder);
+    if(err) {
+        return err;
+    }
+    acyclicTimer.stop();
 //    printf("calculating acyclic tasks -- DONE\n");
 
-    uint64_t n_iter = 0;
-    // calculating the rest of max delays iteratively, if there are cyclic data dependencies
+    PhaseTimer cyclicTimer(stats, AnalysisStats::Cyclic);
+    uint64_t n_iter = 0; // maximum number of iterations among components
+    // calculating the rest of max delays iteratively, if there are cyclic data dependencies:
+    // every strongly connected component of cyclic tasks is iterated to its own fixed point,
+    // after all components it depends on
     if(!cyclicTasksOrder.empty()) {
-        int64_t sum = 0;
-        int64_t sum_pre = -1;
         printf("some delay calculation subtasks have cyclic data dependency,\nthey will be calculated iteratively.\n");
-        while(sum_pre < sum && n_iter < cyclicMaxIter) {
-            printf("iteration %lu... (interrupt after %lu)\n", n_iter+1, cyclicMaxIter);
-            sum_pre = sum;
-            sum = 0;
-            for(auto delayTask: cyclicTasksOrder) {
-                delayTask->clear_bp();
+        for(size_t i = 0; i < cyclicComponents.size(); i++) {
+            uint64_t n_iter_comp = 0;
+            Error err = (cyclicSolver == CyclicWorklist) ? calcComponentWorklist(i, n_iter_comp) :
+                                                           calcComponentSweep(i, n_iter_comp);
+            if(err) {
+                return err;
             }
-            for(auto delayTask: cyclicTasksOrder) {
-                delayTask->get_input_data();
-                Error err = delayTask->calc_delay_max();
-                if(err) {
-                    return err;
-                }
-//                if(print) {
-//                    printf("cyclic:  vl %d to port %d (%s): dmin=%ld, prelim jit=%ld [iter %d]\n",
-//                           delayTask->vl->id, delayTask->out_pseudo_id,
-//                           delayTask->elem == Device::F ? "F" : "P",
-//                           delayTask->delay.dmin(), delayTask->delay.jit(), delayTask->iter);
-//                }
-                sum += delayTask->delay.jit();
-            }
-            n_iter++;
-            assert(sum_pre <= sum);
-        }
-        if(sum_pre < sum) {
-            std::string verbose =
-                    std::string("iterative calculation of delays with cyclic data dependency took too much iterations (over ") +
-                    std::to_string(cyclicMaxIter) +
-                    "), maybe it's divergent";
-            return Error(Error::CyclicTooLong, verbose);
+            n_iter = std::max(n_iter, n_iter_comp);
         }
     }
+    cyclicTimer.stop();
+    if(stats != nullptr) {
+        stats->cyclicIterations = std::max(stats->cyclicIterations, n_iter);
+    }
 //    printf("calculating cyclic tasks -- DONE\n");
 
     for(auto vl: getAllVlinks()) {
         for(auto [_, vnode]: vl->dst) {
-            vnode->e2e = vnode->prev->delayTasks[{Device::P, vnode->in->id}].get()->delay;
+            auto lastTask = vnode->prev->delayTasks[{Device::P, vnode->in->id}].get();
+            if(!isCalculated(lastTask)) {
+                continue;
+            }
+            vnode->e2e = lastTask->delay;
+            if(sink != nullptr) {
+                sink->write(vnode);
+            }
             DelayData e2e = vnode->e2e;
             if(print) {
                 printf("VL %d to %d: maxDelay = %li lB (%.0f us), jit = %li lB (%.0f us), minDelay = %li lB (%.0f us)\n",
@@ -758,36 +855,321 @@ Error VlinkConfig::calcDelays(bool print) {
     }
 //    printf("obtaining E2E delay values -- DONE\n");
     assert(cyclicTasksOrder.empty() == (n_iter == 0));
-    printf("Calculated %d local delays, %lu without cyclic data dependencies and %lu with cyclic data dependencies.\n",
-           n_tasks, acyclicTasksOrder.size(), cyclicTasksOrder.size());
+    if(partial) {
+        printf("Recalculated %zu of %d local delays, %lu without cyclic data dependencies and %lu with cyclic data dependencies.\n",
+               tasks.size(), n_tasks, acyclicTasksOrder.size(), cyclicTasksOrder.size());
+    } else {
+        printf("Calculated %d local delays, %lu without cyclic data dependencies and %lu with cyclic data dependencies.\n",
+               n_tasks, acyclicTasksOrder.size(), cyclicTasksOrder.size());
+    }
     if(n_iter > 0) {
-        printf("There were cyclic data dependencies between local delay calculation subtasks,\n  but those subtasks were calculated in %lu iterations.\n",
-               n_iter);
+        printf("There were cyclic data dependencies between local delay calculation subtasks,\n  but those subtasks were calculated in %lu iterations (%zu components).\n",
+               n_iter, cyclicComponents.size());
     } else {
         printf("There were no cyclic data dependencies between local delay calculation subtasks.\n");
     }
     return Error::Success;
 }
 
+// widening of iterations of a cyclic component (VlinkConfig::cyclicWiden). when the growth of the jitter sum
+// slows down to about geometric, its limit is extrapolated by the ratio of increments over the last iterations,
+// and all jitters of the component are scaled by the ratio of the limit to the sum, damped to rather stay below
+// the fixed point. the iteration goes on from there until delays don't change. such a fixed point is not below
+// the least one, which iterations without widening reach, if it is not below the delays before the first widening.
+// iterations from over the least fixed point settle slowly, so a widening is rolled back if the next iteration
+// decreases the sum
+struct CyclicWidening
+{
+    static constexpr size_t span = 4; // number of iterations the ratio of increments is measured over
+    static constexpr double minGrowth = 1e-3; // the sum is not widened when it grows by a smaller part of itself
+
+    const std::vector<DelayTask*>& component;
+    std::vector<int64_t> sums; // jitter sum after every iteration since the last change of delays
+    std::vector<DelayData> delaysFirst; // delays before the first widening
+    std::vector<DelayData> delaysLast; // delays before the last widening
+    double damping = 0.8; // part of the extrapolated growth to widen by, halved after a rollback
+    int64_t sumWide = -1; // sum right after the last widening, until the next iteration
+    bool enabled;
+    bool widened = false; // delays are widened and they may be over the least fixed point
+
+    CyclicWidening(const std::vector<DelayTask*>& component, bool enabled)
+        : component(component), enabled(enabled) {}
+
+    int64_t jitterSum() const {
+        int64_t sum = 0;
+        for(auto delayTask: component) {
+            sum += delayTask->delay.jit();
+        }
+        return sum;
+    }
+
+    void setDelays(const std::vector<DelayData>& delays) {
+        for(size_t k = 0; k < component.size(); k++) {
+            component[k]->delay = delays[k];
+        }
+    }
+
+    // called after every iteration with the jitter sum of the component,
+    // returns true if delays of the component are widened or rolled back
+    bool next(int64_t sum) {
+        if(!enabled) {
+            return false;
+        }
+        if(sumWide >= 0) {
+            bool rollback = sum < sumWide;
+            sumWide = -1;
+            if(rollback) {
+                setDelays(delaysLast);
+                damping /= 2;
+                sums = {jitterSum()};
+                return true;
+            }
+        }
+        sums.push_back(sum);
+        size_t n = sums.size();
+        if(n < span + 2) {
+            return false;
+        }
+        int64_t inc = sums[n-1] - sums[n-2];
+        int64_t inc_pre = sums[n-1-span] - sums[n-2-span];
+        if(inc <= 0 || inc >= inc_pre || static_cast<double>(inc) < minGrowth * static_cast<double>(sum)) {
+            return false;
+        }
+        double ratio = std::pow(static_cast<double>(inc) / static_cast<double>(inc_pre), 1. / span);
+        double factor = 1 + static_cast<double>(inc) * ratio / (1 - ratio) / static_cast<double>(sum) * damping;
+        delaysLast.clear();
+        for(auto delayTask: component) {
+            delaysLast.push_back(delayTask->delay);
+            auto jitWide = static_cast<int64_t>(std::ceil(static_cast<double>(delayTask->delay.jit()) * factor));
+            delayTask->delay = DelayData(delayTask->vl, delayTask->delay.dmin(), jitWide);
+        }
+        if(!widened) {
+            delaysFirst = delaysLast;
+            widened = true;
+        }
+        sumWide = jitterSum();
+        sums.clear();
+        return true;
+    }
+
+    // called when delays don't change anymore, returns false if the fixed point is below the delays
+    // before the first widening in some task. then these delays are restored and widening is disabled
+    bool accept() {
+        for(size_t k = 0; widened && k < component.size(); k++) {
+            if(component[k]->delay.jit() < delaysFirst[k].jit()) {
+                setDelays(delaysFirst);
+                enabled = false;
+                widened = false;
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+Error VlinkConfig::calcComponentSweep(size_t i, uint64_t& n_iter) {
+    const auto& component = cyclicComponents[i];
+    // a single task without a loop to itself depends only on final data, one pass is enough
+    auto outputs = taskGraph.outputsOf(component[0]->index);
+    bool single = component.size() == 1 &&
+            std::find(outputs.begin(), outputs.end(), component[0]->index) == outputs.end();
+    int64_t sum = 0;
+    int64_t sum_pre = -1;
+    CyclicWidening widening(component, cyclicWiden && !single);
+    bool converged = false;
+    n_iter = 0;
+    while(!converged && n_iter < cyclicMaxIter) {
+        if(!single) {
+            printf("component %zu (%zu subtasks): iteration %lu... (interrupt after %lu)\n",
+                   i, component.size(), n_iter+1, cyclicMaxIter);
+        }
+        sum_pre = sum;
+        sum = 0;
+        bool changed = false;
+        for(auto delayTask: component) {
+            delayTask->clear_bp();
+        }
+        for(auto delayTask: component) {
+            DelayData delay_pre = delayTask->delay;
+            Error err = delayTask->calc_delay_max();
+            if(err) {
+                return err;
+            }
+//            if(print) {
+//                printf("cyclic:  vl %d to port %d (%s): dmin=%ld, prelim jit=%ld [iter %d]\n",
+//                       delayTask->vl->id, delayTask->out_pseudo_id,
+//                       delayTask->elem == Device::F ? "F" : "P",
+//                       delayTask->delay.dmin(), delayTask->delay.jit(), delayTask->iter);
+//            }
+            changed = changed || delayTask->delay != delay_pre;
+            sum += delayTask->delay.jit();
+        }
+        n_iter++;
+        assert(sum_pre <= sum || widening.widened);
+        if(single) {
+            break;
+        }
+        // after widening delays may decrease, then the sum doesn't show convergence
+        converged = widening.widened ? !changed : sum_pre >= sum;
+        if(converged ? !widening.accept() : widening.next(sum)) {
+            converged = false;
+            sum = widening.jitterSum();
+            sum_pre = -1;
+        }
+    }
+    if(!single && !converged) {
+        std::string verbose =
+                std::string("iterative calculation of delays with cyclic data dependency took too much iterations (over ") +
+                std::to_string(cyclicMaxIter) +
+                "), maybe it's divergent";
+        return Error(Error::CyclicTooLong, verbose);
+    }
+    return Error::Success;
+}
+
+Error VlinkConfig::calcComponentWorklist(size_t i, uint64_t& n_iter) {
+    const auto& component = cyclicComponents[i];
+    // every task is calculated at least once, after that only if delay of one of its inputs has changed.
+    // QRTA keeps its busy period and results while its input delays are the same.
+    // with widening, every component.size() calculations are taken as an iteration
+    std::deque<DelayTask*> worklist(component.begin(), component.end());
+    worklistCalcs.resize(tasks.size());
+    inWorklist.resize(tasks.size());
+    for(auto delayTask: component) {
+        worklistCalcs[delayTask->index] = 0;
+        inWorklist[delayTask->index] = true;
+    }
+    CyclicWidening widening(component, cyclicWiden && component.size() > 1);
+    size_t n_calc = 0; // calculations since the last iteration for widening
+    n_iter = 0;
+    while(!worklist.empty()) {
+        auto delayTask = worklist.front();
+        worklist.pop_front();
+        inWorklist[delayTask->index] = false;
+        uint64_t& n_calc_task = worklistCalcs[delayTask->index];
+        if(n_calc_task >= cyclicMaxIter) {
+            std::string verbose =
+                    std::string("iterative calculation of delays with cyclic data dependency took too much iterations (over ") +
+                    std::to_string(cyclicMaxIter) +
+                    "), maybe it's divergent";
+            return Error(Error::CyclicTooLong, verbose);
+        }
+        DelayData delay_pre = delayTask->delay;
+        Error err = delayTask->calc_delay_max();
+        if(err) {
+            return err;
+        }
+        n_calc_task++;
+        n_iter = std::max(n_iter, n_calc_task);
+        assert(delay_pre.jit() <= delayTask->delay.jit() || n_calc_task == 1 || widening.widened);
+        bool widened = false;
+        if(++n_calc == component.size()) {
+            n_calc = 0;
+            widened = widening.next(widening.jitterSum());
+        }
+        if(worklist.empty() && delayTask->delay == delay_pre && !widened) {
+            widened = !widening.accept();
+        }
+        // all tasks of the component are calculated again from widened delays
+        if(widened) {
+            for(auto task: component) {
+                if(!inWorklist[task->index]) {
+                    inWorklist[task->index] = true;
+                    worklist.push_back(task);
+                }
+            }
+            continue;
+        }
+        if(delayTask->delay == delay_pre) {
+            continue;
+        }
+        // tasks of next components are calculated later anyway
+        for(int j: taskGraph.outputsOf(delayTask->index)) {
+            if(tasks[j]->component == static_cast<int>(i) && !inWorklist[j]) {
+                inWorklist[j] = true;
+                worklist.push_back(tasks[j]);
+            }
+        }
+    }
+    if(component.size() > 1) {
+        printf("component %zu (%zu subtasks): converged, at most %lu calculations of a subtask\n",
+               i, component.size(), n_iter);
+    }
+    return Error::Success;
+}
+
 Vlink* VlinkConfig::getVlink(int id) const {
     auto found = vlinks.find(id);
     assert(found != vlinks.end());
     return found->second.get();
 }
 
+void VlinkConfig::buildIndex() {
+    // ids are small numbers in practice, but don't build tables for sparse ones
+    auto denseSize = [](int max_id, size_t n) -> size_t {
+        return (max_id >= 0 && static_cast<size_t>(max_id) < 4 * n + 1024) ? max_id + 1 : 0;
+    };
+    int max_device_id = devices.empty() ? -1 : devices.rbegin()->first;
+    int max_port_id = std::max(_portDevice.empty() ? -1 : _portDevice.rbegin()->first,
+                               links.empty() ? -1 : links.rbegin()->first);
+    bool nonNegative = (devices.empty() || devices.begin()->first >= 0) &&
+                       (_portDevice.empty() || _portDevice.begin()->first >= 0) &&
+                       (links.empty() || links.begin()->first >= 0);
+    _devicesById.clear();
+    _portDeviceById.clear();
+    _linksById.clear();
+    if(!nonNegative) {
+        return;
+    }
+    _devicesById.assign(denseSize(max_device_id, devices.size()), nullptr);
+    for(const auto& [id, device]: devices) {
+        if(!_devicesById.empty()) {
+            _devicesById[id] = device.get();
+        }
+    }
+    size_t n_ports = denseSize(max_port_id, _portDevice.size() + links.size());
+    _portDeviceById.assign(n_ports, -1);
+    _linksById.assign(n_ports, -1);
+    for(auto [portId, deviceId]: _portDevice) {
+        if(n_ports > 0) {
+            _portDeviceById[portId] = deviceId;
+        }
+    }
+    for(auto [portId, portId2]: links) {
+        if(n_ports > 0) {
+            _linksById[portId] = portId2;
+        }
+    }
+}
+
+void VlinkConfig::buildVlinkIndex() {
+    for(auto device: getAllDevices()) {
+        device->buildVlinkIndex();
+    }
+}
+
 Device* VlinkConfig::getDevice(int id) const {
+    if(id >= 0 && static_cast<size_t>(id) < _devicesById.size() && _devicesById[id] != nullptr) {
+        return _devicesById[id];
+    }
     auto found = devices.find(id);
     assert(found != devices.end());
     return found->second.get();
 }
 
 int VlinkConfig::connectedPort(int portId) const {
+    if(portId >= 0 && static_cast<size_t>(portId) < _linksById.size() && _linksById[portId] >= 0) {
+        return _linksById[portId];
+    }
     auto found = links.find(portId);
     assert(found != links.end());
     return found->second;
 }
 
 int VlinkConfig::portDevice(int portId) const {
+    if(portId >= 0 && static_cast<size_t>(portId) < _portDeviceById.size() && _portDeviceById[portId] >= 0) {
+        return _portDeviceById[portId];
+    }
     auto found = _portDevice.find(portId);
     assert(found != _portDevice.end());
     return found->second;
@@ -811,7 +1193,12 @@ std::vector<Device*> VlinkConfig::getAllDevices() const {
     return res;
 }
 
-VlinkConfig::VlinkConfig(): scheme("CIOQ"), n_tasks(0) {}
+VlinkConfig::VlinkConfig(): scheme("CIOQ"), bpSolver(BpIter), cyclicSolver(CyclicSweep), cyclicWiden(false), cioqMapper(CioqMapBasic), n_threads(1), n_tasks(0), stats(nullptr) {}
+
+// delay tasks are in memory of devices, which are destroyed before vlinks
+VlinkConfig::~VlinkConfig() {
+    clearDelayTasks();
+}
 
 std::map<int, double> VlinkConfig::bwUsage() {
     std::map<int, double> res;
@@ -828,16 +1215,11 @@ void DelayTask::clear_bp() {
 }
 
 void DelayTask::get_input_data() {
-    std::map<std::pair<int, int>, DelayData> input_data;
     if(inputs.empty()) {
         return;
     }
-    for(auto[vlBranch, delaytask]: inputs) {
-        assert(delaytask != nullptr);
-        input_data[vlBranch] = delaytask->delay;
-    }
     assert(qrta != nullptr);
-    qrta->setInDelays(input_data);
+    qrta->setInDelays(inputs);
 }
 
 // calculate real delay_min and initial version of delay_max
@@ -865,6 +1247,7 @@ Error DelayTask::calc_delay_max() {
     if(inputs.empty()) {
         dmax = vl->smax + vl->jit0b;
     } else {
+        std::lock_guard<std::mutex> lock(qrta->mutex);
         get_input_data();
         Error err = qrta->calc(vl, vnode_next->in->id); // TODO check if right second arg
         if(err) {
@@ -918,121 +1301,96 @@ void CioqMap::setMap(const std::map<int, std::map<int, int>>& _queueTable, const
     }
 
     // build all comps (= independent components = components of fabric-induced subgraphs of the switch traffic graph)
-    auto device_port_ids = device->getAllPortIds();
-    for(auto in_id: device_port_ids) {
-        for(int queue_id = 0; queue_id < n_queues; queue_id++) {
-            // find any output port from this input queue with any vlinks to this output port
-            int out_pseudo_id = -1;
-            for(auto cur_out_id: device_port_ids) {
-                int cur_out_pseudo_id = config->connectedPort(cur_out_id);
-                if(getQueueId(in_id, cur_out_pseudo_id) == queue_id &&
-                    device->hasVlinks(in_id, cur_out_pseudo_id))
-                {
-                    out_pseudo_id = cur_out_pseudo_id;
-                    break;
-                }
-            }
-            if(out_pseudo_id == -1) {
-                continue;
-            }
-            auto found = compsIndex.find({in_id, out_pseudo_id});
-            if(found != compsIndex.end()) {
-                continue;
-            }
-            auto comp_edges = buildComp(in_id, queue_id);
-            if(comp_edges.empty()) {
-                continue;
-            }
-            comps.push_back(std::make_unique<PortsSubgraph>(comps.size(), comp_edges));
-            PortsSubgraph* comp = comps[comps.size()-1].get();
-            std::set<std::pair<int, int>> comp_queues;
-            for(auto edge: comp_edges) {
-                assert(compsIndex.find(edge) == compsIndex.end());
-                compsIndex[edge] = comp;
-            }
+    comps.clear();
+    compsIndex.clear();
+    for(auto& comp_edges: buildComps()) {
+        comps.push_back(std::make_unique<PortsSubgraph>(comps.size(), std::move(comp_edges)));
+        PortsSubgraph* comp = comps[comps.size()-1].get();
+        for(auto edge: comp->edges) {
+            assert(compsIndex.find(edge) == compsIndex.end());
+            compsIndex[edge] = comp;
         }
     }
 
+#ifndef NDEBUG
     // DEBUG assertions about compsIndex
+    auto device_port_ids = device->getAllPortIds();
     for(auto in_id: device_port_ids) {
         for(auto out_id: device_port_ids) {
             int out_pseudo_id = config->connectedPort(out_id);
-            if(compsIndex.find({in_id, out_pseudo_id}) == compsIndex.end()) {
-                if(device->hasVlinks(in_id, out_pseudo_id)) {
-                    auto comp_edges = buildComp(in_id, getQueueId(in_id, out_pseudo_id));
-                    assert(comp_edges.empty());
-                }
-            }
+            assert(device->hasVlinks(in_id, out_pseudo_id) ==
+                   (compsIndex.find({in_id, out_pseudo_id}) != compsIndex.end()));
         }
     }
+#endif
 }
 
-std::set<std::pair<int, int>> CioqMap::buildComp(int in_port_id, int queue_id) const {
-    std::map<int, bool> in_port_ids_seen;
-    std::map<int, bool> out_port_ids_seen;
-    std::set<std::pair<int, int>> edges;
-    int fabric_id = getFabricId(in_port_id, queue_id);
+std::vector<std::set<std::pair<int, int>>> CioqMap::buildComps() const {
     auto device_in_ids = device->getAllPortIds();
     auto device_out_pseudo_ids = device->getAllOutPortPseudoIds();
+    size_t n_in = device_in_ids.size();
+    size_t n_nodes = n_in + device_out_pseudo_ids.size(); // per fabric
+    int n_fabric_ids = 0;
+    for(auto [_, fabric_id]: fabricTable) {
+        n_fabric_ids = std::max(n_fabric_ids, fabric_id + 1);
+    }
 
-    in_port_ids_seen[in_port_id] = false;
-    bool has_unseen = true;
-    while(has_unseen) {
-        has_unseen = false;
-
-        for(auto& it: in_port_ids_seen) {
-            auto[in_id, in_seen] = it;
-            if(in_seen) continue;
-            for(auto out_id: device_out_pseudo_ids) {
-                if(device->hasVlinks(in_id, out_id) &&
-                    getFabricIdByEdge(in_id, out_id) == fabric_id)
-                {
-//                    if(edges.find({in_id, out_id}) == edges.end()) {
-//                        printf("from input %d found edge %d -> %d\n", in_id, in_id, out_id);
-//                    }
-                    edges.insert({in_id, out_id});
-                    auto found = out_port_ids_seen.find(out_id);
-                    if(found == out_port_ids_seen.end()) {
-                        out_port_ids_seen[out_id] = false;
-                        has_unseen = true;
-                    }
-                }
-            }
-            it.second = true;
-        }
-
-        for(auto& it: out_port_ids_seen) {
-            auto[out_id, out_seen] = it;
-            if(out_seen) continue;
-            for(auto in_id: device_in_ids) {
-                if(device->hasVlinks(in_id, out_id) &&
-                    getFabricIdByEdge(in_id, out_id) == fabric_id)
-                {
-//                    if(edges.find({in_id, out_id}) == edges.end()) {
-//                        printf("from output %d found edge %d -> %d\n", out_id, in_id, out_id);
-//                    }
-                    edges.insert({in_id, out_id});
-                    auto found = in_port_ids_seen.find(in_id);
-                    if(found == in_port_ids_seen.end()) {
-                        in_port_ids_seen[in_id] = false;
-                        has_unseen = true;
-                    }
-                }
+    // union-find on nodes <fabric, input port> and <fabric, output port>,
+    // an edge with vlinks joins its input and output port nodes of its fabric
+    std::vector<size_t> parent(n_fabric_ids * n_nodes);
+    for(size_t node = 0; node < parent.size(); node++) {
+        parent[node] = node;
+    }
+    auto root = [&parent](size_t node) {
+        while(parent[node] != node) {
+            parent[node] = parent[parent[node]];
+            node = parent[node];
+        }
+        return node;
+    };
+    std::vector<bool> hasEdges(parent.size(), false);
+    std::vector<std::tuple<size_t, int, int>> edges; // input port node, input port id, output port pseudo id
+    for(size_t i = 0; i < n_in; i++) {
+        int in_id = device_in_ids[i];
+        for(size_t j = 0; j < device_out_pseudo_ids.size(); j++) {
+            int out_id = device_out_pseudo_ids[j];
+            if(!device->hasVlinks(in_id, out_id)) {
+                continue;
             }
-            it.second = true;
+            size_t fabric_id = getFabricIdByEdge(in_id, out_id);
+            size_t in_node = fabric_id * n_nodes + i;
+            size_t out_node = fabric_id * n_nodes + n_in + j;
+            parent[root(in_node)] = root(out_node);
+            hasEdges[in_node] = true;
+            edges.emplace_back(in_node, in_id, out_id);
         }
     }
-    for(auto[id, seen]: in_port_ids_seen) {
-        assert(seen); // DEBUG
+
+    // components are numbered in order of their first input queue
+    std::vector<int> compByRoot(parent.size(), -1);
+    std::vector<std::set<std::pair<int, int>>> res;
+    for(size_t i = 0; i < n_in; i++) {
+        for(int queue_id = 0; queue_id < n_queues; queue_id++) {
+            auto found = fabricTable.find({device_in_ids[i], queue_id});
+            if(found == fabricTable.end()) {
+                continue;
+            }
+            size_t in_node = found->second * n_nodes + i;
+            if(hasEdges[in_node] && compByRoot[root(in_node)] < 0) {
+                compByRoot[root(in_node)] = static_cast<int>(res.size());
+                res.emplace_back();
+            }
+        }
     }
-    for(auto[id, seen]: out_port_ids_seen) {
-        assert(seen); // DEBUG
+    for(auto [in_node, in_id, out_id]: edges) {
+        int comp_id = compByRoot[root(in_node)];
+        assert(comp_id >= 0);
+        res[comp_id].insert({in_id, out_id});
     }
-    return edges;
+    return res;
 }
 
 void generateTableBasic(Device* device, int n_queues, int n_fabrics, bool print) {
-    assert(n_queues == 2);
     assert(n_fabrics % n_queues == 0);
 
     auto in_ports_ids = device->getAllPortIds();
@@ -1045,8 +1403,10 @@ void generateTableBasic(Device* device, int n_queues, int n_fabrics, bool print)
         int in_port_id = in_ports_ids[i];
         // out port -> queue id
         std::map<int, int> portQueueTable;
+        // fabrics are grouped by n_queues, queues of a port are cyclically shifted over fabrics of its group
+        int groupStart = (i % n_fabrics) / n_queues * n_queues;
         for(int queueId = 0; queueId < n_queues; queueId++) {
-            int fabricId = i % n_fabrics + queueId * (1 - ((i % n_fabrics) % n_queues) * n_queues);
+            int fabricId = groupStart + (i % n_fabrics - groupStart + queueId) % n_queues;
             assert(fabricId >= 0);
             assert(fabricId < n_fabrics);
             fabricTable[{in_port_id, queueId}] = fabricId;
@@ -1054,7 +1414,7 @@ void generateTableBasic(Device* device, int n_queues, int n_fabrics, bool print)
         for(int j = 0; j < n_ports; j++) {
             int out_port_id = in_ports_ids[j];
             int out_port_pseudo_id = device->config->connectedPort(out_port_id);
-            int queueId = j % 2;
+            int queueId = j % n_queues;
             assert(queueId >= 0);
             assert(queueId < n_queues);
             portQueueTable[out_port_pseudo_id] = queueId;
@@ -1064,12 +1424,239 @@ void generateTableBasic(Device* device, int n_queues, int n_fabrics, bool print)
     device->cioqMap->setMap(queueTable, fabricTable, print);
 }
 
+// state of generateTableBalanced: queue of every edge and fabric of every input queue,
+// ports are numbered by their position in device->getAllPortIds()
+struct CioqBalance
+{
+    int n_ports;
+    int n_queues;
+    int n_fabrics;
+    std::vector<std::vector<double>> rate; // [in][out] sum of smax/bag of VLs, in fractions of link rate
+    std::vector<std::vector<int>> queue; // [in][out] queue id
+    std::vector<std::vector<int>> fabric; // [in][queue] fabric id
+
+    // <max load of a component, sum of squared loads of components> of all components in fabric f
+    std::pair<double, double> fabricLoad(int f) const {
+        // union-find on input ports [0, n_ports) and output ports [n_ports, 2*n_ports)
+        std::vector<int> parent(2 * n_ports);
+        for(int node = 0; node < 2 * n_ports; node++) {
+            parent[node] = node;
+        }
+        auto root = [&parent](int node) {
+            while(parent[node] != node) {
+                parent[node] = parent[parent[node]];
+                node = parent[node];
+            }
+            return node;
+        };
+        for(int i = 0; i < n_ports; i++) {
+            for(int j = 0; j < n_ports; j++) {
+                if(rate[i][j] > 0 && fabric[i][queue[i][j]] == f) {
+                    parent[root(i)] = root(n_ports + j);
+                }
+            }
+        }
+        std::vector<double> load(2 * n_ports, 0);
+        for(int i = 0; i < n_ports; i++) {
+            for(int j = 0; j < n_ports; j++) {
+                if(rate[i][j] > 0 && fabric[i][queue[i][j]] == f) {
+                    load[root(i)] += rate[i][j];
+                }
+            }
+        }
+        double max = 0, sum2 = 0;
+        for(double l: load) {
+            max = std::max(max, l);
+            sum2 += l * l;
+        }
+        return {max, sum2};
+    }
+};
+
+// objective of the mapping: maximum load of a component first, then sum of squared loads
+static std::pair<double, double> totalLoad(const std::vector<std::pair<double, double>>& loads) {
+    double max = 0, sum2 = 0;
+    for(auto [fmax, fsum2]: loads) {
+        max = std::max(max, fmax);
+        sum2 += fsum2;
+    }
+    return {max, sum2};
+}
+
+static bool lessLoad(std::pair<double, double> a, std::pair<double, double> b) {
+    const double eps = 1e-12;
+    if(a.first < b.first - eps) {
+        return true;
+    }
+    return a.first <= b.first + eps && a.second < b.second - eps;
+}
+
+void generateTableBalanced(Device* device, int n_queues, int n_fabrics, bool print) {
+    assert(n_fabrics % n_queues == 0);
+
+    auto in_ports_ids = device->getAllPortIds();
+    CioqBalance st;
+    st.n_ports = in_ports_ids.size();
+    st.n_queues = n_queues;
+    st.n_fabrics = n_fabrics;
+    int n_ports = st.n_ports;
+    std::vector<int> out_pseudo_ids(n_ports);
+    for(int j = 0; j < n_ports; j++) {
+        out_pseudo_ids[j] = device->config->connectedPort(in_ports_ids[j]);
+    }
+    st.rate.assign(n_ports, std::vector<double>(n_ports, 0));
+    for(int i = 0; i < n_ports; i++) {
+        for(int j = 0; j < n_ports; j++) {
+            for(auto vnode: device->getVlinks(in_ports_ids[i], out_pseudo_ids[j])) {
+                st.rate[i][j] += static_cast<double>(vnode->vl->smax) / vnode->vl->bagB;
+            }
+        }
+    }
+
+    // greedy queue assignment: output ports of an input port are distributed between its queues
+    // in order of decreasing rate, each to the least loaded queue (unused ones as in generateTableBasic)
+    st.queue.assign(n_ports, std::vector<int>(n_ports, 0));
+    std::vector<std::vector<double>> queueLoad(n_ports, std::vector<double>(n_queues, 0));
+    for(int i = 0; i < n_ports; i++) {
+        std::vector<int> outs;
+        for(int j = 0; j < n_ports; j++) {
+            st.queue[i][j] = j % n_queues;
+            if(st.rate[i][j] > 0) {
+                outs.push_back(j);
+            }
+        }
+        std::stable_sort(outs.begin(), outs.end(), [&](int a, int b) { return st.rate[i][a] > st.rate[i][b]; });
+        for(int j: outs) {
+            int k = std::min_element(queueLoad[i].begin(), queueLoad[i].end()) - queueLoad[i].begin();
+            st.queue[i][j] = k;
+            queueLoad[i][k] += st.rate[i][j];
+        }
+    }
+
+    // greedy fabric assignment: input queues in order of decreasing load, each to the fabric
+    // with the least resulting load (the least used one among equal), queues of one input port in different fabrics
+    st.fabric.assign(n_ports, std::vector<int>(n_queues, -1));
+    std::vector<int> n_fabric_queues(n_fabrics, 0);
+    std::vector<std::pair<int, int>> queues;
+    for(int i = 0; i < n_ports; i++) {
+        for(int k = 0; k < n_queues; k++) {
+            queues.emplace_back(i, k);
+        }
+    }
+    std::stable_sort(queues.begin(), queues.end(), [&](std::pair<int, int> a, std::pair<int, int> b) {
+        return queueLoad[a.first][a.second] > queueLoad[b.first][b.second];
+    });
+    std::vector<std::pair<double, double>> loads(n_fabrics, {0, 0});
+    for(auto [i, k]: queues) {
+        int best = -1;
+        std::pair<double, double> bestLoad;
+        for(int f = 0; f < n_fabrics; f++) {
+            if(std::find(st.fabric[i].begin(), st.fabric[i].end(), f) != st.fabric[i].end()) {
+                continue;
+            }
+            st.fabric[i][k] = f;
+            auto load = st.fabricLoad(f);
+            st.fabric[i][k] = -1;
+            if(best < 0 || lessLoad(load, bestLoad) ||
+               (!lessLoad(bestLoad, load) && n_fabric_queues[f] < n_fabric_queues[best])) {
+                best = f;
+                bestLoad = load;
+            }
+        }
+        assert(best >= 0);
+        st.fabric[i][k] = best;
+        n_fabric_queues[best]++;
+        loads[best] = bestLoad;
+    }
+
+    // local search: move an output port to another queue of its input port,
+    // or swap fabrics of two input queues, while it decreases the objective
+    const int maxPasses = 20;
+    auto total = totalLoad(loads);
+    bool improved = true;
+    for(int pass = 0; pass < maxPasses && improved; pass++) {
+        improved = false;
+        for(int i = 0; i < n_ports; i++) {
+            for(int j = 0; j < n_ports; j++) {
+                if(st.rate[i][j] == 0) {
+                    continue;
+                }
+                int k0 = st.queue[i][j];
+                for(int k = 0; k < n_queues; k++) {
+                    if(k == k0) {
+                        continue;
+                    }
+                    int f0 = st.fabric[i][k0], f = st.fabric[i][k];
+                    st.queue[i][j] = k;
+                    auto newLoads = loads;
+                    newLoads[f0] = st.fabricLoad(f0);
+                    newLoads[f] = st.fabricLoad(f);
+                    auto newTotal = totalLoad(newLoads);
+                    if(lessLoad(newTotal, total)) {
+                        loads = std::move(newLoads);
+                        total = newTotal;
+                        k0 = k;
+                        improved = true;
+                    } else {
+                        st.queue[i][j] = k0;
+                    }
+                }
+            }
+        }
+        for(size_t a = 0; a < queues.size(); a++) {
+            for(size_t b = a + 1; b < queues.size(); b++) {
+                auto [i1, k1] = queues[a];
+                auto [i2, k2] = queues[b];
+                int f1 = st.fabric[i1][k1], f2 = st.fabric[i2][k2];
+                if(f1 == f2 || (i1 != i2 &&
+                   (std::find(st.fabric[i1].begin(), st.fabric[i1].end(), f2) != st.fabric[i1].end() ||
+                    std::find(st.fabric[i2].begin(), st.fabric[i2].end(), f1) != st.fabric[i2].end()))) {
+                    continue;
+                }
+                std::swap(st.fabric[i1][k1], st.fabric[i2][k2]);
+                auto newLoads = loads;
+                newLoads[f1] = st.fabricLoad(f1);
+                newLoads[f2] = st.fabricLoad(f2);
+                auto newTotal = totalLoad(newLoads);
+                if(lessLoad(newTotal, total)) {
+                    loads = std::move(newLoads);
+                    total = newTotal;
+                    improved = true;
+                } else {
+                    std::swap(st.fabric[i1][k1], st.fabric[i2][k2]);
+                }
+            }
+        }
+    }
+
+    std::map<int, std::map<int, int>> queueTable;
+    std::map<std::pair<int, int>, int> fabricTable;
+    for(int i = 0; i < n_ports; i++) {
+        for(int k = 0; k < n_queues; k++) {
+            fabricTable[{in_ports_ids[i], k}] = st.fabric[i][k];
+        }
+        for(int j = 0; j < n_ports; j++) {
+            queueTable[in_ports_ids[i]][out_pseudo_ids[j]] = st.queue[i][j];
+        }
+    }
+    if(print) {
+        printf("==== device %d: balanced CIOQ mapping, max component load %f\n", device->id, total.first);
+    }
+    device->cioqMap->setMap(queueTable, fabricTable, print);
+}
+
 bool PortsSubgraph::isConnected(int node_in, int node_out) const {
     auto found = edges.find({node_in, node_out});
     return (found != edges.end());
 }
 
-int64_t QRTA::busyPeriod(const std::map<std::pair<int,int>, DelayData>& inDelays, VlinkConfig* config) {
+static void addBpIterations(VlinkConfig* config, uint64_t n_iter) {
+    if(config->stats != nullptr) {
+        config->stats->bpIterations.fetch_add(n_iter, std::memory_order_relaxed);
+    }
+}
+
+int64_t QRTA::busyPeriod(const InDelays& inDelays, VlinkConfig* config) {
     uint64_t it = 1;
     int64_t bp = 1;
     int64_t bpPrev = 0;
@@ -1081,44 +1668,150 @@ int64_t QRTA::busyPeriod(const std::map<std::pair<int,int>, DelayData>& inDelays
             bp += numPackets(bpPrev, vl->bagB, delay.jit()) * vl->smax;
         }
         if(config->bpMaxIter != 0 && it >= config->bpMaxIter) {
+            addBpIterations(config, it);
             return -1;
         }
     }
+    addBpIterations(config, it - 1);
     return bp;
 }
 
-// == Rk,j(t) - Jk, k == curVlId
-int64_t QRTA::delayFunc(int64_t t, Vlink* curVl, int curBranchId) const {
-    int64_t res = -t;
+// busy period is the least fixed point bp >= 1 of the staircase function
+// W(t) = sum(numPackets(t, bag_i, jit_i) * smax_i), which busyPeriod() reaches by iterating bp = W(bp).
+// here every iteration jumps to the least fixed point of a lower bound of W on [bp, inf):
+// each VL keeps its exact number of packets up to its next step after bp
+// (n_i packets, then n_i + 1 packets during one more bag), and after that it's bounded by (t + jit_i) / bag_i.
+// this lower bound is piecewise linear and its least fixed point is found by a sweep through its breakpoints.
+// that point is not greater than the busy period, and not less than W(bp),
+// so the result is the same as of busyPeriod(), but near link saturation it takes much less iterations.
+int64_t QRTA::busyPeriodAccel(const InDelays& inDelays, VlinkConfig* config) {
+    // since time point "at", the lower bound of W is changed by "da + ds * t"
+    struct event_t {
+        int64_t at;
+        long double da;
+        long double ds;
+    };
+    std::vector<event_t> events;
+    events.reserve(2 * inDelays.size());
+    long double rate = 0; // sum(smax_i / bag_i) == total_rate()
+    long double base = 0; // sum(smax_i * jit_i / bag_i)
     for(auto [vlBranch, delay]: inDelays) {
-        auto [vlId, branchId] = vlBranch;
         auto vl = delay.vl();
-        assert(vl->id == vlId);
-        bool cur = (vl->id == curVl->id) && (branchId == curBranchId);
-        res += numPacketsUp(t, vl->bagB, (!cur) * delay.jit()) * vl->smax;
+        rate += static_cast<long double>(vl->smax) / vl->bagB;
+        base += static_cast<long double>(vl->smax) * delay.jit() / vl->bagB;
+    }
+    // floor of a fixed point of a lower bound, with a margin for rounding errors
+    auto lowerPoint = [](long double x) -> int64_t {
+        return static_cast<int64_t>(std::floor(x * (1 - 1e-12L))) - 1;
+    };
+
+    // analytic lower bound: bp >= sum(smax_i * (bp + jit_i) / bag_i)
+    int64_t bp = 1;
+    if(rate < 1) {
+        bp = std::max(bp, lowerPoint(base / (1 - rate)));
+    }
+    for(uint64_t it = 1; ; it++) {
+        int64_t bpNext = 0;
+        events.clear();
+        for(auto [vlBranch, delay]: inDelays) {
+            auto vl = delay.vl();
+            int64_t n = numPackets(bp, vl->bagB, delay.jit());
+            int64_t step = n * vl->bagB - delay.jit() + 1; // first time point with n+1 packets
+            bpNext += n * vl->smax;
+            events.push_back({step, static_cast<long double>(vl->smax), 0});
+            events.push_back({step - 1 + vl->bagB,
+                              static_cast<long double>(vl->smax) * delay.jit() / vl->bagB - (n + 1) * vl->smax,
+                              static_cast<long double>(vl->smax) / vl->bagB});
+        }
+        if(bpNext == bp) {
+            addBpIterations(config, it);
+            return bp;
+        }
+        if(bpNext < bp) {
+            // may happen only because of rounding errors, fall back to plain iteration
+            addBpIterations(config, it);
+            return busyPeriod(inDelays, config);
+        }
+        if(config->bpMaxIter != 0 && it >= config->bpMaxIter) {
+            addBpIterations(config, it);
+            return -1;
+        }
+        // the lower bound is equal to a + s * t between breakpoints
+        std::sort(events.begin(), events.end(),
+                  [](const event_t& a, const event_t& b) -> bool { return a.at < b.at; });
+        long double a = bpNext;
+        long double s = 0;
+        long double x = bpNext;
+        for(const auto& event: events) {
+            if(s < 1 && std::max(x, a / (1 - s)) < event.at) {
+                break;
+            }
+            a += event.da;
+            s += event.ds;
+            x = event.at;
+        }
+        if(s < 1) {
+            x = std::max(x, a / (1 - s));
+        }
+        bp = std::max(bpNext, lowerPoint(x));
     }
-    return res;
 }
 
-// == Rk,j(q)* - Jk, k == curVlId
-int64_t QRTA::delayFuncRem(int q, Vlink* curVl, int curBranchId) const {
-    int64_t value = 0;
-    int64_t bags = (q - 1) * curVl->bagB;
+WorkloadSweep::WorkloadSweep(const InDelays& inDelays, Vlink* curVl, int curBranchId)
+    : sum(0)
+{
+    terms.reserve(inDelays.size());
     for(auto [vlBranch, delay]: inDelays) {
         auto [vlId, branchId] = vlBranch;
         auto vl = delay.vl();
-        assert(vl->id == vlId);
-        bool cur = (vl->id == curVl->id) && (branchId == curBranchId);
-        value += vl->smax * (
-                !cur
-                ? numPacketsUp(std::min(bp - curVl->smax, bags), vl->bagB, delay.jit())
-                : q);
+        bool cur = curVl != nullptr && (vlId == curVl->id) && (branchId == curBranchId);
+        int64_t jit = (!cur) * delay.jit();
+        int64_t n = numPacketsUp(0, vl->bagB, jit);
+        terms.push_back({vl->bagB, jit, vl->smax, n});
+        steps.push({n * vl->bagB - jit, terms.size() - 1});
+        sum += n * vl->smax;
+    }
+}
+
+void WorkloadSweep::advance(int64_t t) {
+    while(steps.top().first <= t) {
+        auto i = steps.top().second;
+        steps.pop();
+        auto& term = terms[i];
+        int64_t n = numPacketsUp(t, term.bag, term.jit);
+        sum += (n - term.n) * term.smax;
+        term.n = n;
+        steps.push({n * term.bag - term.jit, i});
+    }
+}
+
+void QRTA::setInDelays(const std::pmr::map<std::pair<int, int>, DelayTask*>& inputs) {
+    if(inTasks.empty()) {
+        inDelays.clear();
+        for(auto [vlBranch, delayTask]: inputs) {
+            assert(delayTask != nullptr);
+            inTasks.push_back(delayTask);
+            inDelays.emplace_back(vlBranch, DelayData());
+        }
+        results.assign(inDelays.size(), DelayData());
+    }
+    assert(inTasks.size() == inputs.size());
+    bool changed = false;
+    for(size_t i = 0; i < inTasks.size(); i++) {
+        if(inDelays[i].second != inTasks[i]->delay) {
+            inDelays[i].second = inTasks[i]->delay;
+            changed = true;
+        }
+    }
+    if(changed) {
+        bp = -1;
+        clear_results();
     }
-    return std::min(bp, value) - bags;
 }
 
 Error QRTA::clear_bp() {
     bp = -1;
+    clear_results();
     return Error::Success;
 }
 
@@ -1132,7 +1825,9 @@ Error QRTA::calc_bp() {
                     + " times bigger)";
             return Error(Error::BpEndless, verbose);
         }
-        bp = busyPeriod(inDelays, config);
+        bp = config->bpSolver == VlinkConfig::BpAccel
+                ? busyPeriodAccel(inDelays, config)
+                : busyPeriod(inDelays, config);
         if(bp < 0) {
             std::string verbose =
                     "QRTA calculation of busy period is converging too long (over "
@@ -1145,60 +1840,107 @@ Error QRTA::calc_bp() {
     return Error::Success;
 }
 
-Error QRTA::calc(Vlink* curVl, int curBranchId) {
-    Error err = calc_bp();
-    if(err) {
-        return err;
+void QRTA::buildProfile() {
+    int64_t smaxMin = -1;
+    for(auto [vlBranch, delay]: inDelays) {
+        if(smaxMin < 0 || delay.vl()->smax < smaxMin) {
+            smaxMin = delay.vl()->smax;
+        }
     }
+    profile.clear();
+    WorkloadSweep sweep(inDelays, nullptr, -1);
+    for(int64_t t = 0; t <= bp - smaxMin; t = sweep.nextStep()) {
+        sweep.advance(t);
+        profile.emplace_back(t, sweep.value());
+    }
+}
+
+int64_t QRTA::profileValue(int64_t t) const {
+    auto found = std::upper_bound(profile.begin(), profile.end(), t,
+            [](int64_t t, const std::pair<int64_t, int64_t>& point) -> bool { return t < point.first; });
+    assert(found != profile.begin());
+    return (found - 1)->second;
+}
+
+// delay of VL branch k is its input dmax plus the maximum of
+// delayFunc(t) == Rk(t) - Jk == sum(numPacketsUp(t, bag_i, jit_i) * smax_i) - t, t in [0, bp - smax_k] and
+// delayFuncRem(q) == Rk(q)* - Jk == min(bp, sum(numPacketsUp(t, bag_i, jit_i) * smax_i) with q packets of k) - t,
+// t == min(bp - smax_k, (q - 1) * bag_k), q in [numPacketsUp(bp - smin_k, bag_k, 0), numPackets(bp, bag_k, jit_k)].
+// both differ from the profile only in the term of this branch:
+// it's taken with zero jitter, which is numPackets(t, bag, jit) - numPackets(t, bag, 0) packets less
+DelayData QRTA::calcBranch(const DelayData& curDelay) const {
+    Vlink* curVl = curDelay.vl();
+    int64_t bag = curVl->bagB;
+    int64_t tMax = bp - curVl->smax;
+    int64_t jitBags = curDelay.jit() / bag;
+    int64_t jitRem = curDelay.jit() % bag;
+    // == (numPackets(t, bag, jit) - numPackets(t, bag, 0)) * smax
+    auto jitExcess = [&](int64_t t) -> int64_t {
+        return (jitBags + (t % bag >= bag - jitRem)) * curVl->smax;
+    };
 
     int64_t delayFuncMax = -1;
     int64_t delayFuncValue;
 
-    // calc delayFunc in chosen points, part 1
-    for(int64_t t = 0; t <= bp - curVl->smax; t += curVl->bagB) {
-        delayFuncValue = delayFunc(t, curVl, curBranchId);
+    // calc delayFunc in chosen points: 0 and all points where one of the VLs gets one more packet
+    // (between these points delayFunc only decreases)
+    size_t i = 0;
+    int64_t nextBag = 0;
+    uint64_t n_points = 0;
+    for(int64_t t = 0; t <= tMax; n_points++) {
+        while(i < profile.size() && profile[i].first <= t) {
+            i++;
+        }
+        delayFuncValue = profile[i-1].second - jitExcess(t) - t;
         if(delayFuncValue > delayFuncMax) {
             delayFuncMax = delayFuncValue;
         }
-    }
-
-    // calc delayFunc in chosen points, part 2
-    DelayData curDelay;
-    bool curDelay_filled = false;
-    for(auto [vlBranch, delay]: inDelays) {
-        auto[vlId, branchId] = vlBranch;
-        if(vlId == curVl->id && branchId == curBranchId) {
-            curDelay = delay;
-            curDelay_filled = true;
-            continue;
-        }
-        auto vl = delay.vl();
-        for(int64_t t = roundToMultiple(delay.jit(), vl->bagB) - delay.jit();
-            t <= bp - curVl->smax;
-            t += vl->bagB)
-        {
-            delayFuncValue = delayFunc(t, curVl, curBranchId);
-            if(delayFuncValue > delayFuncMax) {
-                delayFuncMax = delayFuncValue;
-            }
+        if(nextBag <= t) {
+            nextBag += bag;
         }
+        t = i < profile.size() ? std::min(profile[i].first, nextBag) : nextBag;
     }
-    assert(curDelay_filled);
 
     // calc delayFuncRem in chosen points
-    int qMin = numPacketsUp(bp - curVl->smin, curVl->bagB, 0);
-    int qMax = numPackets(bp, curVl->bagB, curDelay.jit());
+    int qMin = numPacketsUp(bp - curVl->smin, bag, 0);
+    int qMax = numPackets(bp, bag, curDelay.jit());
     for(int q = qMin; q <= qMax; q++) {
-        delayFuncValue = delayFuncRem(q, curVl, curBranchId);
+        int64_t bags = (q - 1) * bag;
+        int64_t t = std::min(tMax, bags);
+        // current VL branch is counted as q packets instead of numPacketsUp(t, bag, jit)
+        int64_t value = profileValue(t) + (q - numPacketsUp(t, bag, curDelay.jit())) * curVl->smax;
+        delayFuncValue = std::min(bp, value) - bags;
         if(delayFuncValue > delayFuncMax) {
             delayFuncMax = delayFuncValue;
         }
     }
+    if(config->stats != nullptr) {
+        config->stats->addCandidatePoints(n_points, std::max(qMax - qMin + 1, 0));
+    }
     assert(delayFuncMax >= 0);
     int64_t dmax = delayFuncMax + curDelay.dmax();
     int64_t dmin = curDelay.dmin() + curVl->smin;
     assert(dmax >= dmin);
-    calc_result = DelayData(curVl, dmin, dmax-dmin);
+    return DelayData(curVl, dmin, dmax-dmin);
+}
+
+Error QRTA::calc(Vlink* curVl, int curBranchId) {
+    Error err = calc_bp();
+    if(err) {
+        return err;
+    }
+    std::pair<int, int> vlBranch = {curVl->id, curBranchId};
+    auto foundIn = std::lower_bound(inDelays.begin(), inDelays.end(), vlBranch,
+            [](const InDelays::value_type& in, const std::pair<int, int>& key) -> bool { return in.first < key; });
+    assert(foundIn != inDelays.end() && foundIn->first == vlBranch);
+    auto& result = results[foundIn - inDelays.begin()];
+    if(!result.ready()) {
+        if(profile.empty()) {
+            buildProfile();
+        }
+        result = calcBranch(foundIn->second);
+    }
+    calc_result = result;
     return Error::Success;
 }
 
@@ -5,10 +5,16 @@
 #include <iostream>
 #include <cstdio>
 #include <memory>
+#include <memory_resource>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <cassert>
 #include <set>
+#include <queue>
+#include <deque>
+#include <mutex>
+#include <atomic>
 
 class Vlink;
 class Vnode;
@@ -19,16 +25,46 @@ class VlinkConfig;
 class CioqMap;
 class PortsSubgraph;
 class QRTA;
+class AnalysisStats;
+
+// owner of an object allocated from a memory resource (Vlink::arena, Device::arena)
+class ArenaDelete {
+public:
+    ArenaDelete(std::pmr::memory_resource* arena = nullptr) : arena(arena) {}
+
+    template<typename T>
+    void operator()(T* p) const {
+        p->~T();
+        arena->deallocate(p, sizeof(T), alignof(T));
+    }
+
+private:
+    std::pmr::memory_resource* arena;
+};
+
+template<typename T>
+using ArenaOwn = std::unique_ptr<T, ArenaDelete>;
+
+template<typename T, typename... Args>
+ArenaOwn<T> makeArenaOwn(std::pmr::memory_resource* arena, Args&&... args) {
+    void* p = arena->allocate(sizeof(T), alignof(T));
+    try {
+        return ArenaOwn<T>(new(p) T(std::forward<Args>(args)...), ArenaDelete(arena));
+    } catch(...) {
+        arena->deallocate(p, sizeof(T), alignof(T));
+        throw;
+    }
+}
 
 using VlinkOwn = std::unique_ptr<Vlink>;
-using VnodeOwn = std::unique_ptr<Vnode>;
+using VnodeOwn = ArenaOwn<Vnode>;
 using DeviceOwn = std::unique_ptr<Device>;
-using DelayTaskOwn = std::unique_ptr<DelayTask>;
+using DelayTaskOwn = ArenaOwn<DelayTask>;
 using PortOwn = std::unique_ptr<Port>;
 using VlinkConfigOwn = std::unique_ptr<VlinkConfig>;
 using CioqMapOwn = std::unique_ptr<CioqMap>;
 using PortsSubgraphOwn = std::unique_ptr<PortsSubgraph>;
-using QRTAOwn = std::unique_ptr<QRTA>;
+using QRTAOwn = ArenaOwn<QRTA>;
 
 class Error {
 public:
@@ -104,11 +140,79 @@ bool operator==(Error::ErrorType lhs, const Error& rhs);
 
 bool operator!=(Error::ErrorType lhs, const Error& rhs);
 
+// contiguous range of task indices in TaskGraph
+class TaskRange
+{
+public:
+    TaskRange(const int* first, const int* last): first(first), last(last) {}
+
+    const int* begin() const { return first; }
+
+    const int* end() const { return last; }
+
+    size_t size() const { return last - first; }
+
+private:
+    const int* first;
+    const int* last;
+};
+
+// dense form of the delay task graph: task i is config->tasks[i] (DelayTask::index == i),
+// edges of DelayTask::output_for and the reverse ones are stored in CSR form (offsets into flat arrays).
+// each input task is listed once, even if it is a few times in DelayTask::inputs with different branches.
+class TaskGraph
+{
+public:
+    void build(const std::vector<DelayTask*>& tasks);
+
+    size_t size() const { return outputStart.empty() ? 0 : outputStart.size() - 1; }
+
+    TaskRange inputsOf(int i) const {
+        return {inputIds.data() + inputStart[i], inputIds.data() + inputStart[i+1]};
+    }
+
+    TaskRange outputsOf(int i) const {
+        return {outputIds.data() + outputStart[i], outputIds.data() + outputStart[i+1]};
+    }
+
+private:
+    std::vector<int> inputStart;
+    std::vector<int> inputIds;
+    std::vector<int> outputStart;
+    std::vector<int> outputIds;
+};
+
+// receiver of e2e delays of VLs from VlinkConfig::calcDelays, called for every destination when its e2e is set
+class ResultSink
+{
+public:
+    virtual ~ResultSink() = default;
+
+    virtual void write(const Vnode* dest) = 0;
+};
+
 class VlinkConfig
 {
 public:
     VlinkConfig();
 
+    ~VlinkConfig();
+
+    // method of busy period calculation in QRTA:
+    // BpIter - plain fixed-point iteration,
+    // BpAccel - accelerated iteration over a piecewise-linear lower bound (same results in less iterations)
+    enum bp_solver_t {BpIter, BpAccel};
+
+    // method of iteration over cyclic dependent delay tasks:
+    // CyclicSweep - recalculate all tasks of a component until the sum of their jitters stops growing,
+    // CyclicWorklist - recalculate a task only when delay of one of its inputs has changed
+    enum cyclic_solver_t {CyclicSweep, CyclicWorklist};
+
+    // generation of CIOQ queue and fabric tables of switches:
+    // CioqMapBasic - fixed round-robin tables (generateTableBasic),
+    // CioqMapBalanced - tables minimizing maximum load of fabric components (generateTableBalanced)
+    enum cioq_mapper_t {CioqMapBasic, CioqMapBalanced};
+
     int64_t linkRate; // R, byte/ms
     std::string scheme;
     std::map<int, VlinkOwn> vlinks;
@@ -119,11 +223,32 @@ public:
     int n_queues;
     uint64_t bpMaxIter;
     uint64_t cyclicMaxIter;
+    bp_solver_t bpSolver;
+    cyclic_solver_t cyclicSolver;
+    // accelerate iterations of cyclic components by extrapolation of the jitter sum (CyclicWidening in algo.cpp),
+    // results are upper bounds of the iterated ones
+    bool cyclicWiden;
+    cioq_mapper_t cioqMapper;
+    int n_threads; // number of threads for calculating delays
     int n_tasks;
+    AnalysisStats* stats; // phase times and counters are added to it if it is set
 
+    // delay tasks of the last calculation (all of them but after calcTasksOf), tasks[i]->index == i.
+    // the input task of the same VL goes before a task
     std::vector<DelayTask*> tasks;
+    TaskGraph taskGraph;
     std::vector<DelayTask*> acyclicTasksOrder;
     std::vector<DelayTask*> cyclicTasksOrder;
+    // strongly connected components of cyclic tasks in topological order of the condensation,
+    // tasks of a component are ordered as in cyclicTasksOrder
+    std::vector<std::vector<DelayTask*>> cyclicComponents;
+
+    // build dense lookup tables by device and port ids, called when links, _portDevice and devices are complete.
+    // getDevice(), connectedPort() and portDevice() use maps until it is called
+    void buildIndex();
+
+    // build per-edge VL index in all devices, called when all vlinks are constructed
+    void buildVlinkIndex();
 
     Vlink* getVlink(int id) const;
 
@@ -140,11 +265,41 @@ public:
     std::vector<Device*> getAllDevices() const;
 
     // random order of vlinks and destinations processing if shuffle=true
-    // prints delays if print=true
-    Error calcDelays(bool print = false);
+    // prints delays if print=true, passes them to sink if it is given.
+    // can be called again after changes of VL loads, scheme, CIOQ tables or VLs
+    Error calcDelays(bool print = false, ResultSink* sink = nullptr);
+
+    // calculates delays of all existing delay tasks made by calcDelays again, after changes of VL loads
+    // or start jitters only (delay tasks depend on scheme, CIOQ tables and VLs, but not on their loads)
+    Error recalcDelays(bool print = false, ResultSink* sink = nullptr);
+
+    // calculates delays of existing delay tasks in subset only (it replaces tasks), the other tasks must have
+    // their delays already. subset must be closed under output_for. only destinations whose last task
+    // is in subset get e2e, and are printed and passed to sink
+    Error calcTasksOf(std::vector<DelayTask*> subset, bool print = false, ResultSink* sink = nullptr);
+
+    // removes delay tasks and QRTAs made by calcDelays
+    void clearDelayTasks();
+
+    // adds vl (constructed with this config, so its vnodes are in ports already) and updates VL index of its devices.
+    // delay tasks must be rebuilt after it
+    void addVlink(VlinkOwn vl);
+
+    // removes VL and its vnodes from ports and devices. delay tasks must be rebuilt after it
+    void removeVlink(int id);
 
     Error buildTables(bool print = false);
 
+    // builds CIOQ tables of one switch
+    void buildTable(Device* device, bool print = false);
+
+    // creates QRTAs of device and delay tasks of VL hops from device, without their inputs
+    void createDeviceTasks(Device* device);
+
+    // fills inputs of delay tasks of VL hops from device and output_for of their input tasks,
+    // the input tasks must be created already
+    void linkDeviceTasks(Device* device);
+
     // calculate bwUsage() values on all input ports and return them as map by port number
     std::map<int, double> bwUsage();
 
@@ -153,10 +308,30 @@ public:
     double linkByte2ms(int64_t linkByte) { return static_cast<double>(linkByte) / linkRate; }
 private:
     Error buildDelayTasks();
-    Error _buildDelayTasksCIOQ();
-    Error _buildDelayTasksOQ();
+
+    // dense lookup tables by id, -1 or nullptr for absent ids
+    std::vector<Device*> _devicesById;
+    std::vector<int> _portDeviceById;
+    std::vector<int> _linksById;
 
     Error buildTasksOrder();
+
+    // build taskGraph, acyclic and cyclic tasks order of tasks, inputs not in tasks are treated as calculated
+    Error orderTasks();
+
+    Error calcTasks(bool print, ResultSink* sink);
+
+    // split cyclicTasksOrder into cyclicComponents
+    void buildCyclicComponents();
+
+    // calculate tasks of cyclicComponents[i] until fixed point,
+    // n_iter is set to the maximum number of calculations of a task
+    Error calcComponentSweep(size_t i, uint64_t& n_iter);
+    Error calcComponentWorklist(size_t i, uint64_t& n_iter);
+
+    // state of calcComponentWorklist by task index, entries of a component are reset before it's calculated
+    std::vector<uint64_t> worklistCalcs; // number of calculations of a task
+    std::vector<char> inWorklist;
 };
 
 class Vlink
@@ -167,6 +342,8 @@ public:
 
     VlinkConfig* const config;
     const int id;
+    // memory of the VL tree, released at once with the VL (declared before src to outlive it)
+    std::pmr::monotonic_buffer_resource arena;
     VnodeOwn src; // tree root
     std::map<int, Vnode*> dst; // tree leaves, key is device id
     int bag; // in ms
@@ -175,6 +352,8 @@ public:
     int smin; // in bytes
     double jit0; // jitter of start of packet transfer from source end system, in ms
     int64_t jit0b; // in link-bytes, == ceil(jit0 * config->linkRate)
+    int lmax; // in bytes, as given in input (smax is lmax multiplied by load factor)
+    double jitStart; // in us, as given in input, NaN if not given (jit0 is default then)
 };
 
 class Device
@@ -184,7 +363,7 @@ public:
     enum elem_t {F, P}; // fabric, output port
 
     Device(VlinkConfig* config, type_t type, int id)
-        : config(config), id(id), type(type), cioqMap(nullptr) {}
+        : config(config), id(id), type(type), cioqMap(nullptr), mapPool(&arena), qrtas(&arena) {}
 
     // called when config->_portDevices is complete
     void AddPorts(const std::vector<int>& portIds);
@@ -197,27 +376,52 @@ public:
     std::vector<Vlink*> sourceFor; // Vlinks which have this device as source
 
     CioqMapOwn cioqMap;
-    std::map<std::pair<elem_t, int>, QRTAOwn> qrtas;
+    // memory of QRTAs and delay tasks of VL hops from this device,
+    // released at once when they are all removed (releaseArena)
+    std::pmr::monotonic_buffer_resource arena;
+    // memory of inputs and output_for maps of these tasks. tasks of other devices are added to and
+    // removed from them when the other devices are rebuilt by IncrementalAnalysis, so freed entries are reused
+    std::pmr::unsynchronized_pool_resource mapPool;
+    std::pmr::map<std::pair<elem_t, int>, QRTAOwn> qrtas;
 
     Port* getPort(int portId) const;
 
     std::vector<Port*> getAllPorts() const;
 
+    // releases memory of QRTAs and delay tasks of this device, they must be removed before
+    void releaseArena();
+
     std::vector<Port*> getAllOutPortsIn() const;
 
     std::vector<int> getAllPortIds() const; // sorted by number ascending
 
     std::vector<int> getAllOutPortPseudoIds() const; // sorted by number ascending
 
+    // vnodes holding delay tasks of VL hops from this device:
+    // sources of VLs of an end system, vnodes in all input ports of a switch
+    std::vector<Vnode*> getHopVnodes() const;
+
     // get input port connected with output port portId
     Port* fromOutPort(int portId) const;
 
     // get input port connected with output port with pseudo id portPseudoId (which is id of that input port)
     Port* fromOutPortByPseudoId(int portPseudoId) const;
 
+    // build index of VL branches by edge, called when all vlinks are constructed
+    void buildVlinkIndex();
+
     bool hasVlinks(int in_port_id, int out_port_pseudo_id) const;
 
-    std::vector<Vnode*> getVlinks(int in_port_id, int out_port_pseudo_id) const;
+    // vnodes in port in_port_id (ordered by VL id) whose VLs go to output port out_port_pseudo_id
+    const std::vector<Vnode*>& getVlinks(int in_port_id, int out_port_pseudo_id) const;
+
+private:
+    // vnodes by edge key <in port id, out port pseudo id>
+    std::unordered_map<uint64_t, std::vector<Vnode*>> edgeVlinks;
+
+    static uint64_t edgeKey(int in_port_id, int out_port_pseudo_id) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(in_port_id)) << 32) | static_cast<uint32_t>(out_port_pseudo_id);
+    }
 };
 
 // INPUT PORT
@@ -263,6 +467,14 @@ public:
 
     int64_t dmax() const { return _ready ? _dmax : -1; }
 
+    bool operator==(const DelayData& other) const {
+        return _ready == other._ready && _vl == other._vl && _dmin == other._dmin && _jit == other._jit;
+    }
+
+    bool operator!=(const DelayData& other) const {
+        return !(*this == other);
+    }
+
 private:
     Vlink* _vl;
     int64_t _dmin;
@@ -283,11 +495,11 @@ public:
     Device* const device; // == in->device
     Vnode* const prev; // (also == vnode of same Vlink from prev device's ports, which is unambiguous)
     Port* const in; // in port of this device
-    std::vector<VnodeOwn> next;
+    std::pmr::vector<VnodeOwn> next;
     int outPrev; // == in->outPrev - id of out port of prev device
 
     // key is <element type, branchId>, where branchId == vnodeX->in->id, where vnodeX in this->next
-    std::map<std::pair<Device::elem_t, int>, DelayTaskOwn> delayTasks;
+    std::pmr::map<std::pair<Device::elem_t, int>, DelayTaskOwn> delayTasks;
 
     // e2e delay
     DelayData e2e;
@@ -317,8 +529,8 @@ public:
               in_id(vnode_next->prev->in != nullptr ? vnode_next->prev->in->id : -1),
               out_pseudo_id(vnode_next->in->id),
               id(std::make_tuple(vl->id, vnode_next->in->id, elem)),
-              qrta(qrta), delay(vl, 0, 0),
-              in_cycle(true), iter(0), cyclic_layer(-1), max_input_layer(-1) {}
+              qrta(qrta), delay(vl, 0, 0), inputs(&device->mapPool), output_for(&device->mapPool),
+              in_cycle(true), iter(0), cyclic_layer(-1), max_input_layer(-1), index(-1), component(-1), n_unresolved(0) {}
 
     VlinkConfig* const config;
     Vlink* const vl;
@@ -341,19 +553,24 @@ public:
     // If VL X splits in this->device, and N of its branches through this->device are concurring with
     // the branch of this->vl to this->vnode_next, then N copies of DelayTask VL X on previous device
     // are included in this map, and they are distinguished by branch_id.
-    std::map<std::pair<int, int>, DelayTask*> inputs;
+    std::pmr::map<std::pair<int, int>, DelayTask*> inputs;
 
     // Set of delay tasks for which this delay task contains input data.
     // Let inputs[vl_id, branch_id] == delay_task, then:
     // vl_id == delay_task->vl->id
     // branch_id == delay_task->vnode_next->in->id
     // delay_task->elemType != this->elemType
-    std::map<std::pair<int, int>, DelayTask*> output_for;
+    std::pmr::map<std::pair<int, int>, DelayTask*> output_for;
 
     bool in_cycle;
     int iter;
     int cyclic_layer;
     int max_input_layer;
+    int index; // position in config->tasks
+    int component; // index in config->cyclicComponents, or -1 for acyclic tasks
+
+    // number of input tasks which are not calculated yet, used by DataflowScheduler
+    std::atomic<int> n_unresolved;
 
     void get_input_data();
     void clear_bp();
@@ -364,7 +581,7 @@ public:
 class CioqMap
 {
 public:
-    CioqMap(Device* device, int n_queues = 2, int n_fabrics = 8)
+    CioqMap(Device* device, int n_queues, int n_fabrics)
             : config(device->config), device(device), n_queues(n_queues), n_fabrics(n_fabrics) {}
 
     VlinkConfig* const config;
@@ -394,19 +611,24 @@ public:
 
     int getFabricIdByEdge(int in_port_id, int out_port_id) const;
 
-    // find a component of a fabric-induced subgraph of the switch traffic graph, that has the specified input queue
-    std::set<std::pair<int, int>> buildComp(int in_port_id, int queue_id) const;
+    // find all components of fabric-induced subgraphs of the switch traffic graph (as sets of edges),
+    // in order of their first input queue <input port id, queue id>
+    std::vector<std::set<std::pair<int, int>>> buildComps() const;
 };
 
 void generateTableBasic(Device* device, int n_queues, int n_fabrics, bool print = false);
 
+// greedy assignment of output ports to queues and of queues to fabrics, improved by local search,
+// to minimize maximum total rate of VLs in a component
+void generateTableBalanced(Device* device, int n_queues, int n_fabrics, bool print = false);
+
 // bipartite graph
 class PortsSubgraph
 {
 public:
     PortsSubgraph(int id): id(id) {}
 
-    PortsSubgraph(int id, std::set<std::pair<int, int>> edges): id(id), edges(edges) {}
+    PortsSubgraph(int id, std::set<std::pair<int, int>> edges): id(id), edges(std::move(edges)) {}
 
     int id;
     std::set<std::pair<int, int>> edges;
@@ -443,25 +665,64 @@ inline int64_t roundToMultiple(int64_t x, int64_t k) {
     return x + k * (x % k != 0) - x % k;
 }
 
-class QRTA
+// input delays of a QRTA by <vl id, branch id>, sorted by it
+using InDelays = std::vector<std::pair<std::pair<int, int>, DelayData>>;
+
+// sum(numPacketsUp(t, bag_i, jit_i) * smax_i) over concurring VLs evaluated incrementally for ascending t.
+// if curVl is specified, its branch curBranchId is taken with zero jitter.
+// the sum only changes at steps of the VLs, which are merged into one sequence by a heap,
+// so passing through all steps in [0, T] costs O(steps * log(VLs)) instead of O(steps * VLs).
+class WorkloadSweep
 {
 public:
-    QRTA(VlinkConfig* config): config(config), bp(-1) {}
+    WorkloadSweep(const InDelays& inDelays, Vlink* curVl, int curBranchId);
 
-    // == Rk,CVL(t) - Jk, k == vl->id
-    int64_t delayFunc(int64_t t, Vlink* vl, int cur_branch_id) const;
+    // time of the next step of the sum after current time
+    int64_t nextStep() const { return steps.top().first; }
 
-    // == Rk,CVL(q)* - Jk, k == vl->id
-    int64_t delayFuncRem(int q, Vlink* vl, int cur_branch_id) const;
+    // move current time forward to t
+    void advance(int64_t t);
+
+    // value of the sum in current time
+    int64_t value() const { return sum; }
+
+private:
+    struct term_t {
+        int64_t bag;
+        int64_t jit;
+        int64_t smax;
+        int64_t n; // numPacketsUp in current time
+    };
+
+    std::vector<term_t> terms;
+    // <time of the next step, term index>
+    std::priority_queue<std::pair<int64_t, size_t>, std::vector<std::pair<int64_t, size_t>>,
+                        std::greater<std::pair<int64_t, size_t>>> steps;
+    int64_t sum;
+};
+
+class QRTA
+{
+public:
+    QRTA(VlinkConfig* config): config(config), bp(-1) {}
 
     Error calc_bp();
 
     DelayData calc_result;
 
-    void setInDelays(const std::map<std::pair<int, int>, DelayData>& _inDelays) {
-        inDelays = _inDelays;
+    // takes input delays from the input tasks, which are the same for all DelayTasks sharing this QRTA
+    // and are taken from inputs of the first of them.
+    // bp and results are kept while input delays are the same
+    void setInDelays(const std::pmr::map<std::pair<int, int>, DelayTask*>& inputs);
+
+    // inputs of the DelayTasks are changed, they are taken again by the next setInDelays()
+    void resetInputs() {
+        inTasks.clear();
     }
 
+    // calculates delay of one VL branch into calc_result. delays of all branches are calculated with one
+    // bp and workload profile, and each of them is kept in results until input delays change, so every
+    // branch is calculated once per input delays, and only when a DelayTask asks for it.
     // recalculates bp only if it is empty
     Error calc(Vlink* curVl, int cur_branch_id);
 
@@ -469,12 +730,39 @@ public:
 
     double total_rate();
 
+    // DelayTasks sharing this QRTA hold it while setting input delays and calculating
+    std::mutex mutex;
+
 private:
     VlinkConfig* config;
     int64_t bp;
-    std::map<std::pair<int, int>, DelayData> inDelays;
+    std::vector<const DelayTask*> inTasks; // in order of inDelays
+    InDelays inDelays; // delays of inTasks bp and results are calculated with
+
+    // <t, sum(numPacketsUp(t, bag_i, jit_i) * smax_i)> over all input delays
+    // in 0 and all points where the sum steps up, in [0, bp - min(smax_i)].
+    // all concurring VLs are calculated with this one profile, only their own term is corrected
+    std::vector<std::pair<int64_t, int64_t>> profile;
+
+    // calculated delays in order of inDelays, not ready ones are not calculated yet
+    std::vector<DelayData> results;
+
+    void clear_results() {
+        profile.clear();
+        std::fill(results.begin(), results.end(), DelayData());
+    }
+
+    void buildProfile();
+
+    // profile value in t, t <= bp - min(smax_i)
+    int64_t profileValue(int64_t t) const;
+
+    // calculates delay for VL branch with input delay curDelay, bp and profile must be ready
+    DelayData calcBranch(const DelayData& curDelay) const;
+
+    static int64_t busyPeriod(const InDelays& inDelays, VlinkConfig* config);
 
-    static int64_t busyPeriod(const std::map<std::pair<int, int>, DelayData>& inDelays, VlinkConfig* config);
+    static int64_t busyPeriodAccel(const InDelays& inDelays, VlinkConfig* config);
 };
 
 #endif //DELAYTOOL_ALGO_H
\ No newline at end of file
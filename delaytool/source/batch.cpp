@@ -0,0 +1,238 @@
+#include <cmath>
+#include <chrono>
+#include <charconv>
+#include <mutex>
+#include <atomic>
+#include <glob.h>
+#include "batch.h"
+#include "threadpool.h"
+#include "configio.h"
+#include "configbin.h"
+
+// shortest representation like python's repr, empty if zero and skipZero
+static std::string formatNumber(double value, bool skipZero = false) {
+    if(skipZero && value == 0) {
+        return "";
+    }
+    char buf[32];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    return std::string(buf, res.ptr);
+}
+
+std::string batchCsvHeader() {
+    return "config,n_vlinks,scheme,n_fabrics,"
+           "bw,jitdef,delays_max,delays_mean,jitters_max,jitters_mean,time,rate,"
+           "size_factor,smax_max,smax_mean,bw_min,bw_max,"
+           "bw_mean,bw_var,bw_min_orig,bw_max_orig,"
+           "bw_mean_orig,bw_var_orig,error,times_calc,topology,config_id,config_dir\n";
+}
+
+// file name parts of experiments.py: directory, configuration name (without extension),
+// topology and configuration id from <topology>_final_vls_<id>
+struct ConfigName {
+    std::string dir, name, topology;
+    int id = 0;
+
+    explicit ConfigName(const std::string& fileName) {
+        size_t slash = fileName.find_last_of('/');
+        dir = slash == std::string::npos ? "" : fileName.substr(0, slash);
+        name = slash == std::string::npos ? fileName : fileName.substr(slash + 1);
+        size_t dot = name.find_last_of('.');
+        if(dot != std::string::npos && dot > 0) {
+            name = name.substr(0, dot);
+        }
+        const std::string sep = "_final_vls_";
+        size_t found = name.rfind(sep);
+        if(found != std::string::npos && found > 0) {
+            topology = name.substr(0, found);
+            std::from_chars(name.data() + found + sep.size(), name.data() + name.size(), id);
+        }
+    }
+};
+
+// mean over VLs of mean over their destinations of max delays and jitters in us, as in xml output
+struct DelayStats {
+    double delaysMax = 0, delaysMean = 0, jittersMax = 0, jittersMean = 0;
+};
+
+static DelayStats getDelayStats(VlinkConfig* config) {
+    DelayStats res;
+    auto vlinks = config->getAllVlinks();
+    for(auto vl: vlinks) {
+        double delay = 0, jit = 0;
+        for(auto [_, vnode]: vl->dst) {
+            delay += ceil(1000. * config->linkByte2ms(vnode->e2e.dmax()));
+            jit += ceil(1000. * config->linkByte2ms(vnode->e2e.jit()));
+        }
+        delay /= vl->dst.size();
+        jit /= vl->dst.size();
+        res.delaysMax = std::max(res.delaysMax, delay);
+        res.jittersMax = std::max(res.jittersMax, jit);
+        res.delaysMean += delay;
+        res.jittersMean += jit;
+    }
+    res.delaysMean /= vlinks.size();
+    res.jittersMean /= vlinks.size();
+    return res;
+}
+
+bool runBatch(const std::string& fileName, const SweepSpec& sweep, const BatchOptions& options,
+              const std::function<void(const std::string&)>& onRow) {
+    assert(!sweep.schemes.empty() && !sweep.nFabrics.empty() && !sweep.loads.empty() && !sweep.jitDefs.empty());
+    MappedFile input(fileName);
+    if(!input.ok()) {
+        fprintf(stderr, "error: can't load input file: %s\n", fileName.c_str());
+        return false;
+    }
+    auto text = input.text();
+    VlinkConfigOwn config = isBinConfig(text)
+            ? fromBin(text, sweep.schemes[0], sweep.jitDefs[0], options.forceLinkRate, 1.,
+                      options.bpMaxIter, options.cyclicMaxIter, sweep.nFabrics[0], options.nQueues)
+            : fromXmlText(text, sweep.schemes[0], sweep.jitDefs[0], options.forceLinkRate, 1.,
+                          options.bpMaxIter, options.cyclicMaxIter, sweep.nFabrics[0], options.nQueues);
+    if(config == nullptr) {
+        fprintf(stderr, "error reading from %s\n", fileName.c_str());
+        return false;
+    }
+    config->bpSolver = options.bpSolver;
+    config->cyclicSolver = options.cyclicSolver;
+    config->cyclicWiden = options.cyclicWiden;
+    config->cioqMapper = options.cioqMapper;
+    config->n_threads = std::max(options.n_threads, 1);
+
+    ConfigName configName(fileName);
+    auto bwStatsOrig = getStats(config->bwUsage());
+    double bwAnchor = sweep.byMax ? bwStatsOrig.max : bwStatsOrig.mean;
+
+    // parameters the current CIOQ tables and delay tasks are built for, empty scheme if there are none
+    std::string tablesScheme;
+    int tablesFabrics = -1;
+    double tablesFactor = NAN;
+
+    for(const auto& scheme: sweep.schemes) {
+        bool isCioq = scheme == "CIOQ";
+        size_t n_fabrics_used = isCioq ? sweep.nFabrics.size() : 1;
+        for(size_t k = 0; k < n_fabrics_used; k++) {
+            int nFabrics = sweep.nFabrics[k];
+            for(double load: sweep.loads) {
+                double factor = sweep.byBw ? load / bwAnchor : load;
+                // the bw value factor is calculated from, as experiments.py writes it
+                double bw = sweep.byBw ? load : factor * bwAnchor;
+                for(double jitDef: sweep.jitDefs) {
+                    config->scheme = scheme;
+                    config->n_fabrics = nFabrics;
+                    applyLoad(config.get(), factor, jitDef);
+                    auto bwUsage = config->bwUsage();
+                    auto bwStats = getStats(bwUsage);
+
+                    std::string err;
+                    double time = 0;
+                    DelayStats delayStats;
+                    if(!bwCorrect(bwUsage)) {
+                        err = "bw overload";
+                    } else {
+                        auto t1 = std::chrono::steady_clock::now();
+                        try {
+                            Error calcErr;
+                            // delay tasks depend only on scheme and CIOQ tables, with the same ones
+                            // only delays are calculated again
+                            bool tablesValid = tablesScheme == scheme &&
+                                    (!isCioq || (tablesFabrics == nFabrics &&
+                                                 (config->cioqMapper == VlinkConfig::CioqMapBasic || tablesFactor == factor)));
+                            if(tablesValid) {
+                                calcErr = config->recalcDelays();
+                            } else {
+                                // tables and tasks are built again after a failure
+                                tablesScheme.clear();
+                                if(isCioq) {
+                                    calcErr = config->buildTables();
+                                }
+                                if(!calcErr) {
+                                    calcErr = config->calcDelays();
+                                    tablesScheme = scheme;
+                                    tablesFabrics = nFabrics;
+                                    tablesFactor = factor;
+                                }
+                            }
+                            if(calcErr) {
+                                fprintf(stderr, "error calculating delay (%s, %s): %s, %s\n",
+                                        fileName.c_str(), scheme.c_str(),
+                                        calcErr.TypeString().c_str(), calcErr.Verbose().c_str());
+                                err = "other";
+                            }
+                        } catch(std::exception& e) {
+                            fprintf(stderr, "error calculating delay because of exception: %s\n", e.what());
+                            err = "other";
+                            tablesScheme.clear();
+                        }
+                        time = std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count();
+                    }
+
+                    int smaxMax = 0;
+                    double smaxMean = 0;
+                    if(err.empty()) {
+                        delayStats = getDelayStats(config.get());
+                        auto vlinks = config->getAllVlinks();
+                        for(auto vl: vlinks) {
+                            smaxMax = std::max(smaxMax, vl->smax);
+                            smaxMean += vl->smax;
+                        }
+                        smaxMean /= vlinks.size();
+                    } else {
+                        time = 0;
+                    }
+                    std::string schemeLower = isCioq ? "cioq" : "oq";
+                    std::string row = "\"" + configName.name + "\"," + std::to_string(config->vlinks.size()) + ","
+                            + schemeLower + "," + std::to_string(isCioq ? nFabrics : 0) + ","
+                            + formatNumber(bw) + "," + formatNumber(jitDef) + ","
+                            + formatNumber(delayStats.delaysMax, true) + ","
+                            + formatNumber(delayStats.delaysMean, true) + ","
+                            + formatNumber(delayStats.jittersMax, true) + ","
+                            + formatNumber(delayStats.jittersMean, true) + ","
+                            + formatNumber(time, true) + "," + std::to_string(config->linkRate) + ","
+                            + formatNumber(factor) + "," + std::to_string(smaxMax) + "," + formatNumber(smaxMean) + ","
+                            + formatNumber(bwStats.min, true) + "," + formatNumber(bwStats.max, true) + ","
+                            + formatNumber(bwStats.mean, true) + "," + formatNumber(bwStats.var, true) + ","
+                            + formatNumber(bwStatsOrig.min, true) + "," + formatNumber(bwStatsOrig.max, true) + ","
+                            + formatNumber(bwStatsOrig.mean, true) + "," + formatNumber(bwStatsOrig.var, true) + ","
+                            + "\"" + err + "\"," + (err.empty() ? "1" : "0") + ","
+                            + "\"" + configName.topology + "\"," + std::to_string(configName.id) + ","
+                            + "\"" + configName.dir + "\"\n";
+                    onRow(row);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+std::vector<std::string> expandInputs(const std::vector<std::string>& patterns) {
+    std::vector<std::string> res;
+    for(const auto& pattern: patterns) {
+        glob_t found;
+        if(glob(pattern.c_str(), 0, nullptr, &found) == 0) {
+            res.insert(res.end(), found.gl_pathv, found.gl_pathv + found.gl_pathc);
+        } else {
+            res.push_back(pattern);
+        }
+        globfree(&found);
+    }
+    return res;
+}
+
+int runBatchFiles(const std::vector<std::string>& fileNames, const SweepSpec& sweep, const BatchOptions& options,
+                  int n_jobs, const std::function<void(const std::string&)>& onRow) {
+    std::mutex mutex;
+    std::atomic<int> n_failed(0);
+    ThreadPool pool(std::max(1, std::min<int>(n_jobs, fileNames.size())));
+    pool.parallelFor(fileNames.size(), [&](size_t i) {
+        bool ok = runBatch(fileNames[i], sweep, options, [&](const std::string& row) {
+            std::lock_guard<std::mutex> lock(mutex);
+            onRow(row);
+        });
+        if(!ok) {
+            n_failed++;
+        }
+    });
+    return n_failed;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#ifndef DELAYTOOL_BATCH_H
+#define DELAYTOOL_BATCH_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include "algo.h"
+
+// parameters evaluated for every combination in batch mode
+struct SweepSpec {
+    std::vector<std::string> schemes; // "OQ" or "CIOQ"
+    std::vector<int> nFabrics; // only the first one is used for OQ
+    std::vector<double> loads; // load factors (-f), or link bandwidth usage if byBw
+    bool byBw = false;
+    // loads are maximum link bandwidth usage if byBw, else average usage (by_max of experiments.py).
+    // factors are loads divided by the maximum or average usage with factor 1 (the anchor)
+    bool byMax = true;
+    std::vector<double> jitDefs; // default start jitters, in us
+};
+
+// options of the analysis that are the same for all combinations
+struct BatchOptions {
+    int forceLinkRate = 0;
+    uint64_t bpMaxIter = 0;
+    uint64_t cyclicMaxIter = 0;
+    int nQueues = 2;
+    VlinkConfig::bp_solver_t bpSolver = VlinkConfig::BpIter;
+    VlinkConfig::cyclic_solver_t cyclicSolver = VlinkConfig::CyclicSweep;
+    bool cyclicWiden = false;
+    VlinkConfig::cioq_mapper_t cioqMapper = VlinkConfig::CioqMapBasic;
+    int n_threads = 1;
+};
+
+// header of the csv written by batch mode, the same columns as experiments.py writes to data/exp.csv
+std::string batchCsvHeader();
+
+// loads network configuration from xml or binary file once and evaluates it for every combination of sweep
+// parameters, passing a csv row for each of them to onRow. CIOQ tables and delay tasks are rebuilt only
+// when scheme, number of fabrics or (for the balanced mapping) loads change, otherwise only delays are
+// calculated again. the input and VL trees are reused.
+// false if the file can't be loaded
+bool runBatch(const std::string& fileName, const SweepSpec& sweep, const BatchOptions& options,
+              const std::function<void(const std::string&)>& onRow);
+
+// file names matching the patterns (shell wildcards), sorted for each pattern;
+// a pattern without matches is kept as is to be reported as missing file
+std::vector<std::string> expandInputs(const std::vector<std::string>& patterns);
+
+// runBatch for every file, n_jobs files concurrently. onRow is called under a lock, rows of different
+// files are in order of completion. number of files which can't be loaded
+int runBatchFiles(const std::vector<std::string>& fileNames, const SweepSpec& sweep, const BatchOptions& options,
+                  int n_jobs, const std::function<void(const std::string&)>& onRow);
+
+#endif //DELAYTOOL_BATCH_H
@@ -0,0 +1,265 @@
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <map>
+#include <vector>
+#include <cassert>
+#include "configbin.h"
+#include "xmlscanner.h"
+
+bool isBinConfig(std::string_view data) {
+    return data.size() >= sizeof(binConfigMagic) && memcmp(data.data(), binConfigMagic, sizeof(binConfigMagic)) == 0;
+}
+
+template<typename T>
+static void writeArray(const std::vector<T>& arr, FILE* fp) {
+    fwrite(arr.data(), sizeof(T), arr.size(), fp);
+}
+
+bool xmlToBin(std::string_view text, FILE* fp) {
+    std::vector<BinLink> links;
+    std::vector<BinDevice> devices;
+    std::vector<BinVlink> vlinks;
+    std::vector<BinPath> paths;
+    std::vector<int32_t> ports;
+    std::vector<int> list;
+    try {
+        std::vector<std::string_view> stack;
+        XmlScanner scanner(text);
+        while(scanner.next()) {
+            if(scanner.isEnd) {
+                if(stack.empty() || stack.back() != scanner.name) {
+                    throw std::runtime_error("unexpected end tag " + std::string(scanner.name));
+                }
+                stack.pop_back();
+                continue;
+            }
+            if(isInside(stack, {"afdxxml", "resources"}) && scanner.name == "link") {
+                links.push_back({ParseInt(scanner.requireAttribute("from")),
+                                 ParseInt(scanner.requireAttribute("to")),
+                                 ParseFloat(scanner.requireAttribute("capacity"))});
+            } else if(isInside(stack, {"afdxxml", "resources"}) &&
+                      (scanner.name == "endSystem" || scanner.name == "switch")) {
+                list.clear();
+                ParseIntList(scanner.requireAttribute("ports"), list);
+                devices.push_back({ParseInt(scanner.requireAttribute("number")),
+                                   scanner.name == "switch" ? Device::Switch : Device::End,
+                                   static_cast<uint32_t>(ports.size()), static_cast<uint32_t>(list.size())});
+                ports.insert(ports.end(), list.begin(), list.end());
+            } else if(isInside(stack, {"afdxxml", "virtualLinks"}) && scanner.name == "virtualLink") {
+                auto jitStr = scanner.attribute("jitStart");
+                vlinks.push_back({ParseInt(scanner.requireAttribute("number")),
+                                  ParseInt(scanner.requireAttribute("source")),
+                                  ParseInt(scanner.requireAttribute("bag")),
+                                  ParseInt(scanner.requireAttribute("lmax")),
+                                  jitStr.data() ? ParseFloat(jitStr) : NAN,
+                                  static_cast<uint32_t>(paths.size()), 0});
+            } else if(isInside(stack, {"afdxxml", "virtualLinks", "virtualLink"}) && scanner.name == "path") {
+                list.clear();
+                ParseIntList(scanner.requireAttribute("path"), list);
+                if(list.empty()) {
+                    throw std::runtime_error("empty path");
+                }
+                paths.push_back({static_cast<uint32_t>(ports.size()), static_cast<uint32_t>(list.size())});
+                ports.insert(ports.end(), list.begin(), list.end());
+                vlinks.back().n_paths++;
+            }
+            if(!scanner.isEmpty) {
+                stack.push_back(scanner.name);
+            }
+        }
+        if(scanner.failed()) {
+            throw std::runtime_error("bad xml at offset " + std::to_string(scanner.offset()));
+        }
+        if(links.empty() || vlinks.empty()) {
+            throw std::runtime_error("no links or virtual links");
+        }
+    } catch(std::exception& e) {
+        fprintf(stderr, "exception while reading vl config: %s\n", e.what());
+        return false;
+    }
+
+    BinConfigHeader header = {};
+    memcpy(header.magic, binConfigMagic, sizeof(binConfigMagic));
+    header.version = binConfigVersion;
+    header.n_links = links.size();
+    header.n_devices = devices.size();
+    header.n_vlinks = vlinks.size();
+    header.n_paths = paths.size();
+    header.n_ports = ports.size();
+    fwrite(&header, sizeof(header), 1, fp);
+    writeArray(links, fp);
+    writeArray(devices, fp);
+    writeArray(vlinks, fp);
+    writeArray(paths, fp);
+    writeArray(ports, fp);
+    return !ferror(fp);
+}
+
+// array of n elements of type T at offset in data, nullptr if data is too short
+template<typename T>
+static const T* binArray(std::string_view data, size_t& offset, uint32_t n) {
+    if(offset + sizeof(T) * static_cast<uint64_t>(n) > data.size()) {
+        return nullptr;
+    }
+    auto res = reinterpret_cast<const T*>(data.data() + offset);
+    offset += sizeof(T) * n;
+    return res;
+}
+
+VlinkConfigOwn fromBin(std::string_view data, const std::string& scheme,
+        double jitDefaultValue, int forceLinkRate,
+        double loadFactor, uint64_t bpMaxIter, uint64_t cyclicMaxIter, int nFabrics, int nQueues)
+{
+    size_t offset = 0;
+    auto header = binArray<BinConfigHeader>(data, offset, 1);
+    if(header == nullptr || !isBinConfig(data) || header->version != binConfigVersion) {
+        std::cerr << "error: bad binary config header or version" << std::endl;
+        return nullptr;
+    }
+    auto links = binArray<BinLink>(data, offset, header->n_links);
+    auto devices = binArray<BinDevice>(data, offset, header->n_devices);
+    auto vlinks = binArray<BinVlink>(data, offset, header->n_vlinks);
+    auto paths = binArray<BinPath>(data, offset, header->n_paths);
+    auto ports = binArray<int32_t>(data, offset, header->n_ports);
+    if(ports == nullptr) {
+        std::cerr << "error: binary config is truncated" << std::endl;
+        return nullptr;
+    }
+    if(header->n_links == 0 || header->n_vlinks == 0) {
+        std::cerr << "error: binary config has no links or virtual links" << std::endl;
+        return nullptr;
+    }
+    auto portList = [&](uint32_t begin, uint32_t n) {
+        if(static_cast<uint64_t>(begin) + n > header->n_ports) {
+            throw std::runtime_error("bad port list in binary config");
+        }
+        return std::vector<int>(ports + begin, ports + begin + n);
+    };
+
+    VlinkConfigOwn config = std::make_unique<VlinkConfig>();
+    try {
+        config->linkRate = forceLinkRate == 0 ? static_cast<int64_t>(links[0].capacity) : forceLinkRate;
+        config->n_fabrics = nFabrics;
+        config->n_queues = nQueues;
+        assert(nQueues > 0);
+        assert(nFabrics > 0);
+        assert(nFabrics % nQueues == 0);
+        config->scheme = scheme;
+        assert(scheme == "OQ" || scheme == "CIOQ");
+        config->bpMaxIter = bpMaxIter;
+        config->cyclicMaxIter = cyclicMaxIter;
+
+        for(uint32_t i = 0; i < header->n_links; i++) {
+            if(forceLinkRate == 0 && links[i].capacity != config->linkRate) {
+                std::cerr << "error: bad input resources - all links must have the same capacity" << std::endl;
+                return nullptr;
+            }
+            config->links[links[i].from] = links[i].to;
+            config->links[links[i].to] = links[i].from;
+        }
+
+        // device id -> vector of IDs of its ports
+        std::map<int, std::vector<int>> portNums;
+        for(uint32_t i = 0; i < header->n_devices; i++) {
+            const BinDevice& dev = devices[i];
+            if(dev.type != Device::Switch && dev.type != Device::End) {
+                throw std::runtime_error("bad device type in binary config");
+            }
+            if(dev.type == Device::End && dev.n_ports != 1) {
+                std::cerr << "error: bad input - end systems must have one port" << std::endl;
+                return nullptr;
+            }
+            auto type = static_cast<Device::type_t>(dev.type);
+            auto devPorts = portList(dev.portsBegin, dev.n_ports);
+            for(auto portId: devPorts) {
+                config->_portDevice[portId] = dev.id;
+            }
+            config->devices[dev.id] = std::make_unique<Device>(config.get(), type, dev.id);
+            portNums[dev.id] = std::move(devPorts);
+        }
+        // ports of devices must be linked with ports of devices
+        for(const auto& [num, devPorts]: portNums) {
+            for(auto portId: devPorts) {
+                auto link = config->links.find(portId);
+                if(link == config->links.end() || config->_portDevice.count(link->second) == 0) {
+                    throw std::runtime_error("port " + std::to_string(portId) + " of device " + std::to_string(num) +
+                                             " is not linked with a device in binary config");
+                }
+            }
+        }
+        config->buildIndex();
+        // create Port objects in devices
+        for(auto[num, ports] : portNums) {
+            config->getDevice(num)->AddPorts(ports);
+        }
+
+        for(uint32_t i = 0; i < header->n_vlinks; i++) {
+            const BinVlink& vl = vlinks[i];
+            if(vl.n_paths == 0 || static_cast<uint64_t>(vl.pathsBegin) + vl.n_paths > header->n_paths) {
+                throw std::runtime_error("bad path list of VL " + std::to_string(vl.number) + " in binary config");
+            }
+            if(vl.bag <= 0 || vl.lmax <= 0) {
+                throw std::runtime_error("bag and lmax of VL " + std::to_string(vl.number) +
+                                         " must be positive in binary config");
+            }
+            if(config->vlinks.count(vl.number) > 0) {
+                throw std::runtime_error("duplicate VL " + std::to_string(vl.number) + " in binary config");
+            }
+            auto src = config->devices.find(vl.source);
+            if(src == config->devices.end() || src->second->type != Device::End) {
+                throw std::runtime_error("source of VL " + std::to_string(vl.number) +
+                                         " is not an end system in binary config");
+            }
+            std::vector<std::vector<int>> vlPaths;
+            for(uint32_t k = 0; k < vl.n_paths; k++) {
+                vlPaths.push_back(portList(paths[vl.pathsBegin + k].portsBegin, paths[vl.pathsBegin + k].n_ports));
+                // a path goes from the source through switches to an end system, by linked ports
+                const auto& path = vlPaths.back();
+                if(path.empty()) {
+                    throw std::runtime_error("empty path of VL " + std::to_string(vl.number) + " in binary config");
+                }
+                int prevDeviceId = vl.source;
+                for(size_t j = 0; j < path.size(); j++) {
+                    if(config->_portDevice.count(path[j]) == 0 ||
+                       config->portDevice(config->connectedPort(path[j])) != prevDeviceId ||
+                       (config->getDevice(config->portDevice(path[j]))->type == Device::Switch) != (j + 1 < path.size())) {
+                        throw std::runtime_error("bad path of VL " + std::to_string(vl.number) + " in binary config");
+                    }
+                    prevDeviceId = config->portDevice(path[j]);
+                }
+            }
+            int smax = vl.lmax;
+            if(loadFactor != 1.0) {
+                smax = static_cast<int>(smax * loadFactor);
+            }
+            int smin = std::min(sminDefault, smax);
+            double jit0 = (std::isnan(vl.jitStart) ? jitDefaultValue : vl.jitStart) / 1e3; // in ms
+            config->vlinks[vl.number] = std::make_unique<Vlink>(config.get(), vl.number, vl.source, vlPaths,
+                                                                 vl.bag, smax, smin, jit0);
+            config->vlinks[vl.number]->lmax = vl.lmax;
+            config->vlinks[vl.number]->jitStart = vl.jitStart;
+        }
+        config->buildVlinkIndex();
+    } catch(std::exception& e) {
+        fprintf(stderr, "exception while reading vl config: %s\n", e.what());
+        return nullptr;
+    }
+    printf("%ld vlinks\n", config->vlinks.size());
+    return config;
+}
+
+bool toXmlResults(VlinkConfig* config, FILE* fp) {
+    fprintf(fp, "<afdxxml>\n    <virtualLinks>\n");
+    for(auto vl: config->getAllVlinks()) {
+        fprintf(fp, "        <virtualLink number=\"%d\" lmax=\"%d\" lmin=\"%d\">\n", vl->id, vl->smax, vl->smin);
+        for(auto [deviceId, vnode]: vl->dst) {
+            fprintf(fp, "            <path dest=\"%d\" maxDelay=\"%d\" maxJit=\"%d\"/>\n", deviceId,
+                    static_cast<int>(ceil(1000. * config->linkByte2ms(vnode->e2e.dmax()))),
+                    static_cast<int>(ceil(1000. * config->linkByte2ms(vnode->e2e.jit()))));
+        }
+        fprintf(fp, "        </virtualLink>\n");
+    }
+    fprintf(fp, "    </virtualLinks>\n</afdxxml>\n");
+    return !ferror(fp);
+}
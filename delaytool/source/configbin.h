@@ -0,0 +1,72 @@
+#pragma once
+#ifndef DELAYTOOL_CONFIGBIN_H
+#define DELAYTOOL_CONFIGBIN_H
+
+#include <cstdio>
+#include <cstdint>
+#include <string_view>
+#include "configio.h"
+
+// binary network configuration: resources and VLs of an xml input as they are given there
+// (before applying of link rate, load factor and default jitter options), so it can be used instead of the xml
+// with any options. it is read in place from a mapped file.
+// all numbers are 32-bit in native byte order, the header is followed by arrays of
+// BinLink[n_links], BinDevice[n_devices], BinVlink[n_vlinks], BinPath[n_paths], int32_t[n_ports]
+constexpr char binConfigMagic[4] = {'D', 'T', 'C', 'F'};
+constexpr uint32_t binConfigVersion = 1;
+
+struct BinConfigHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t n_links;
+    uint32_t n_devices;
+    uint32_t n_vlinks;
+    uint32_t n_paths;
+    uint32_t n_ports; // total size of port lists of devices and paths
+    uint32_t reserved;
+};
+
+struct BinLink {
+    int32_t from;
+    int32_t to;
+    float capacity;
+};
+
+struct BinDevice {
+    int32_t id;
+    int32_t type; // Device::type_t
+    uint32_t portsBegin;
+    uint32_t n_ports;
+};
+
+struct BinVlink {
+    int32_t number;
+    int32_t source;
+    int32_t bag;
+    int32_t lmax;
+    float jitStart; // in us, NaN if not given
+    uint32_t pathsBegin;
+    uint32_t n_paths;
+};
+
+struct BinPath {
+    uint32_t portsBegin;
+    uint32_t n_ports;
+};
+
+bool isBinConfig(std::string_view data);
+
+// converts xml text to binary config, errors are printed to stderr
+bool xmlToBin(std::string_view text, FILE* fp);
+
+// same as fromXml for binary config data
+VlinkConfigOwn fromBin(std::string_view data, const std::string& scheme,
+        double jitDefaultValue = jitStartDefault, int forceLinkRate = 0,
+        double loadFactor = 1., uint64_t bpMaxIter = bpMaxIterDefault,
+        uint64_t cyclicMaxIter = cyclicMaxIterDefault, int nFabrics = nFabricsDefault,
+        int nQueues = nQueuesDefault);
+
+// xml with only VLs and maxDelay and maxJit of their paths, for configs without xml input
+bool toXmlResults(VlinkConfig* config, FILE* fp);
+
+#endif //DELAYTOOL_CONFIGBIN_H
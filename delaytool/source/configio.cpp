@@ -5,27 +5,104 @@
 #include <string>
 #include <cassert>
 #include <cmath>
-#include <sstream>
 #include <memory>
+#include <charconv>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "configio.h"
+#include "xmlscanner.h"
 
-std::vector<int> TokenizeCsv(const std::string& str) {
+std::vector<int> TokenizeCsv(std::string_view str) {
     std::vector<int> res;
-    std::stringstream ss(str);
-    int num;
-    while(ss >> num) {
-        res.push_back(num);
-        if (ss.peek() == ',' || ss.peek() == ' ') {
-            ss.ignore();
+    ParseIntList(str, res);
+    return res;
+}
+
+static size_t skipSpaces(std::string_view str) {
+    size_t pos = 0;
+    while(pos < str.size() && (str[pos] == ' ' || str[pos] == '\t' || str[pos] == '\n' || str[pos] == '\r')) {
+        pos++;
+    }
+    if(pos < str.size() && str[pos] == '+') {
+        pos++;
+    }
+    return pos;
+}
+
+template<typename T>
+static T parseNumber(std::string_view str) {
+    size_t pos = skipSpaces(str);
+    T num;
+    auto [ptr, ec] = std::from_chars(str.data() + pos, str.data() + str.size(), num);
+    if(ec == std::errc::invalid_argument) {
+        throw std::invalid_argument("not a number: " + std::string(str));
+    } else if(ec == std::errc::result_out_of_range) {
+        throw std::out_of_range("number is out of range: " + std::string(str));
+    }
+    return num;
+}
+
+int ParseInt(std::string_view str) {
+    return parseNumber<int>(str);
+}
+
+float ParseFloat(std::string_view str) {
+    return parseNumber<float>(str);
+}
+
+void ParseIntList(std::string_view str, std::vector<int>& res) {
+    size_t pos = 0;
+    while(pos < str.size()) {
+        if(str[pos] == ',' || str[pos] == ' ') {
+            pos++;
+            continue;
+        }
+        size_t end = str.find_first_of(", ", pos);
+        if(end == std::string_view::npos) {
+            end = str.size();
         }
+        res.push_back(ParseInt(str.substr(pos, end - pos)));
+        pos = end;
     }
-    return res;
+}
+
+MappedFile::MappedFile(const std::string& fileName) : addr(nullptr), size(0) {
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if(fd < 0) {
+        return;
+    }
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapped != MAP_FAILED) {
+            addr = mapped;
+            size = st.st_size;
+        }
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if(addr != nullptr) {
+        munmap(addr, size);
+    }
+}
+
+// value of attribute of xml element, throws std::invalid_argument if there is none
+static std::string_view attributeOf(const tinyxml2::XMLElement* el, const char* name) {
+    const char* value = el->Attribute(name);
+    if(value == nullptr) {
+        throw std::invalid_argument(std::string("no attribute ") + name + " in element " + el->Name());
+    }
+    return value;
 }
 
 // doc can be modified. it will be used when exporting config to xml with new data
 VlinkConfigOwn fromXml(tinyxml2::XMLDocument& doc, const std::string& scheme,
         double jitDefaultValue, int forceLinkRate,
-        double loadFactor, uint64_t bpMaxIter, uint64_t cyclicMaxIter, int nFabrics)
+        double loadFactor, uint64_t bpMaxIter, uint64_t cyclicMaxIter, int nFabrics, int nQueues)
 {
     VlinkConfigOwn config = std::make_unique<VlinkConfig>();
     try {
@@ -33,12 +110,13 @@ VlinkConfigOwn fromXml(tinyxml2::XMLDocument& doc, const std::string& scheme,
         auto resources = afdxxml->FirstChildElement("resources");
         config->linkRate = forceLinkRate == 0
                            ? static_cast<int64_t>(
-                                   std::stof(resources->FirstChildElement("link")->Attribute("capacity")))
+                                   ParseFloat(attributeOf(resources->FirstChildElement("link"), "capacity")))
                            : forceLinkRate;
         config->n_fabrics = nFabrics;
-        config->n_queues = 2;
-        assert(nFabrics % config->n_queues == 0);
+        config->n_queues = nQueues;
+        assert(nQueues > 0);
         assert(nFabrics > 0);
+        assert(nFabrics % nQueues == 0);
         config->scheme = scheme;
         assert(scheme == "OQ" || scheme == "CIOQ");
         config->bpMaxIter = bpMaxIter;
@@ -47,14 +125,14 @@ VlinkConfigOwn fromXml(tinyxml2::XMLDocument& doc, const std::string& scheme,
         for(auto res = resources->FirstChildElement("link");
              res != nullptr;
              res = res->NextSiblingElement("link")) {
-            if(forceLinkRate == 0 && std::stof(res->Attribute("capacity")) != config->linkRate) {
+            if(forceLinkRate == 0 && ParseFloat(attributeOf(res, "capacity")) != config->linkRate) {
                 std::cerr << "error: bad input resources - all links must have the same capacity" << std::endl;
                 return nullptr;
             } else if(forceLinkRate != 0) {
                 res->SetAttribute("capacity", forceLinkRate);
             }
-            int port1 = std::stoi(res->Attribute("from"));
-            int port2 = std::stoi(res->Attribute("to"));
+            int port1 = ParseInt(attributeOf(res, "from"));
+            int port2 = ParseInt(attributeOf(res, "to"));
             config->links[port1] = port2;
             config->links[port2] = port1;
         }
@@ -65,12 +143,12 @@ VlinkConfigOwn fromXml(tinyxml2::XMLDocument& doc, const std::string& scheme,
         for(auto res = resources->FirstChildElement("endSystem");
              res != nullptr;
              res = res->NextSiblingElement("endSystem")) {
-            std::vector<int> ports = TokenizeCsv(res->Attribute("ports"));
+            std::vector<int> ports = TokenizeCsv(attributeOf(res, "ports"));
             if(ports.size() != 1) {
                 std::cerr << "error: bad input - end systems must have one port" << std::endl;
                 return nullptr;
             }
-            int number = std::stoi(res->Attribute("number"));
+            int number = ParseInt(attributeOf(res, "number"));
             config->_portDevice[ports[0]] = number;
             config->devices[number] = std::make_unique<Device>(config.get(), Device::End, number);
             portNums[number] = ports;
@@ -79,14 +157,15 @@ VlinkConfigOwn fromXml(tinyxml2::XMLDocument& doc, const std::string& scheme,
         for(auto res = resources->FirstChildElement("switch");
              res != nullptr;
              res = res->NextSiblingElement("switch")) {
-            int number = std::stoi(res->Attribute("number"));
-            std::vector<int> ports = TokenizeCsv(res->Attribute("ports"));
+            int number = ParseInt(attributeOf(res, "number"));
+            std::vector<int> ports = TokenizeCsv(attributeOf(res, "ports"));
             for(auto portId: ports) {
                 config->_portDevice[portId] = number;
             }
             config->devices[number] = std::make_unique<Device>(config.get(), Device::Switch, number);
             portNums[number] = ports;
         }
+        config->buildIndex();
         // create Port objects in devices
         for(auto[num, ports] : portNums) {
             config->getDevice(num)->AddPorts(ports);
@@ -97,10 +176,11 @@ VlinkConfigOwn fromXml(tinyxml2::XMLDocument& doc, const std::string& scheme,
              vl != nullptr;
              vl = vl->NextSiblingElement("virtualLink")) {
             std::vector<std::vector<int>> paths;
-            int number = std::stoi(vl->Attribute("number"));
-            int srcId = std::stoi(vl->Attribute("source"));
-            int bag = std::stoi(vl->Attribute("bag"));
-            int smax = std::stoi(vl->Attribute("lmax"));
+            int number = ParseInt(attributeOf(vl, "number"));
+            int srcId = ParseInt(attributeOf(vl, "source"));
+            int bag = ParseInt(attributeOf(vl, "bag"));
+            int lmax = ParseInt(attributeOf(vl, "lmax"));
+            int smax = lmax;
             if(loadFactor != 1.0) {
                 smax = static_cast<int>(smax * loadFactor);
                 vl->SetAttribute("lmax", smax);
@@ -108,17 +188,20 @@ VlinkConfigOwn fromXml(tinyxml2::XMLDocument& doc, const std::string& scheme,
             int smin = std::min(sminDefault, smax);
             vl->SetAttribute("lmin", smin);
             auto jitStr = vl->Attribute("jitStart"); // in us
-            double jit0 = (jitStr ? std::stof(jitStr) : jitDefaultValue) / 1e3; // in ms
+            double jit0 = (jitStr ? ParseFloat(jitStr) : jitDefaultValue) / 1e3; // in ms
             for(auto pathEl = vl->FirstChildElement("path");
                  pathEl != nullptr;
                  pathEl = pathEl->NextSiblingElement("path")) {
-                std::vector<int> path = TokenizeCsv(pathEl->Attribute("path"));
+                std::vector<int> path = TokenizeCsv(attributeOf(pathEl, "path"));
                 assert(!path.empty());
                 paths.push_back(path);
             }
             config->vlinks[number] = std::make_unique<Vlink>(config.get(), number, srcId, paths, bag, smax, smin, jit0);
+            config->vlinks[number]->lmax = lmax;
+            config->vlinks[number]->jitStart = jitStr ? ParseFloat(jitStr) : NAN;
         }
         assert(!config->vlinks.empty());
+        config->buildVlinkIndex();
     } catch(std::exception& e) {
         fprintf(stderr, "exception while reading vl config: %s\n", e.what());
         return nullptr;
@@ -127,6 +210,19 @@ VlinkConfigOwn fromXml(tinyxml2::XMLDocument& doc, const std::string& scheme,
     return config;
 }
 
+void applyLoad(VlinkConfig* config, double loadFactor, double jitDefaultValue) {
+    for(auto vl: config->getAllVlinks()) {
+        applyLoad(vl, loadFactor, jitDefaultValue);
+    }
+}
+
+void applyLoad(Vlink* vl, double loadFactor, double jitDefaultValue) {
+    vl->smax = loadFactor != 1.0 ? static_cast<int>(vl->lmax * loadFactor) : vl->lmax;
+    vl->smin = std::min(sminDefault, vl->smax);
+    vl->jit0 = (std::isnan(vl->jitStart) ? jitDefaultValue : vl->jitStart) / 1e3; // in ms
+    vl->jit0b = std::ceil(vl->jit0 * vl->config->linkRate);
+}
+
 // adding maxDelay and maxJit attributes to VL paths with max e2e delay and jitter values in us
 // and scheme attributes for each switch
 // doc must already contain the resources and VL configuration
@@ -145,13 +241,13 @@ bool toXml(VlinkConfig* config, tinyxml2::XMLDocument& doc) {
         vlEl != nullptr;
         vlEl = vlEl->NextSiblingElement("virtualLink"))
     {
-        int number = std::stoi(vlEl->Attribute("number"));
+        int number = ParseInt(attributeOf(vlEl, "number"));
         Vlink* vl = config->getVlink(number);
         for(auto path = vlEl->FirstChildElement("path");
             path != nullptr;
             path = path->NextSiblingElement("path"))
         {
-            int deviceId = std::stoi(path->Attribute("dest"));
+            int deviceId = ParseInt(attributeOf(path, "dest"));
             auto found = vl->dst.find(deviceId);
             assert(found != vl->dst.end());
             Vnode* vnode = found->second;
@@ -164,6 +260,225 @@ bool toXml(VlinkConfig* config, tinyxml2::XMLDocument& doc) {
     return true;
 }
 
+VlinkConfigOwn fromXmlText(std::string_view text, const std::string& scheme,
+        double jitDefaultValue, int forceLinkRate,
+        double loadFactor, uint64_t bpMaxIter, uint64_t cyclicMaxIter, int nFabrics, int nQueues)
+{
+    VlinkConfigOwn config = std::make_unique<VlinkConfig>();
+    try {
+        config->linkRate = forceLinkRate;
+        config->n_fabrics = nFabrics;
+        config->n_queues = nQueues;
+        assert(nQueues > 0);
+        assert(nFabrics > 0);
+        assert(nFabrics % nQueues == 0);
+        config->scheme = scheme;
+        assert(scheme == "OQ" || scheme == "CIOQ");
+        config->bpMaxIter = bpMaxIter;
+        config->cyclicMaxIter = cyclicMaxIter;
+
+        // device id -> vector of IDs of its ports
+        std::map<int, std::vector<int>> portNums;
+        std::vector<std::pair<int, Device::type_t>> devices;
+        bool resourcesDone = false;
+
+        // attributes of the current VL
+        int number = 0, srcId = 0, bag = 0, lmax = 0, smax = 0;
+        double jitStart = NAN, jit0 = 0;
+        std::vector<std::vector<int>> paths;
+
+        // names of open elements
+        std::vector<std::string_view> stack;
+        XmlScanner scanner(text);
+        while(scanner.next()) {
+            if(scanner.isEnd) {
+                if(stack.empty() || stack.back() != scanner.name) {
+                    throw std::runtime_error("unexpected end tag " + std::string(scanner.name));
+                }
+                stack.pop_back();
+            }
+            if(!scanner.isEnd && isInside(stack, {"afdxxml", "resources"}) && !resourcesDone) {
+                if(scanner.name == "link") {
+                    double capacity = ParseFloat(scanner.requireAttribute("capacity"));
+                    if(config->linkRate == 0) {
+                        config->linkRate = static_cast<int64_t>(capacity);
+                    }
+                    if(forceLinkRate == 0 && capacity != config->linkRate) {
+                        std::cerr << "error: bad input resources - all links must have the same capacity" << std::endl;
+                        return nullptr;
+                    }
+                    int port1 = ParseInt(scanner.requireAttribute("from"));
+                    int port2 = ParseInt(scanner.requireAttribute("to"));
+                    config->links[port1] = port2;
+                    config->links[port2] = port1;
+                } else if(scanner.name == "endSystem" || scanner.name == "switch") {
+                    std::vector<int> ports;
+                    ParseIntList(scanner.requireAttribute("ports"), ports);
+                    int deviceId = ParseInt(scanner.requireAttribute("number"));
+                    auto type = scanner.name == "switch" ? Device::Switch : Device::End;
+                    if(type == Device::End && ports.size() != 1) {
+                        std::cerr << "error: bad input - end systems must have one port" << std::endl;
+                        return nullptr;
+                    }
+                    for(auto portId: ports) {
+                        config->_portDevice[portId] = deviceId;
+                    }
+                    devices.emplace_back(deviceId, type);
+                    portNums[deviceId] = std::move(ports);
+                }
+            } else if(scanner.isEnd && isInside(stack, {"afdxxml"}) && scanner.name == "resources" && !resourcesDone) {
+                for(auto [deviceId, type]: devices) {
+                    config->devices[deviceId] = std::make_unique<Device>(config.get(), type, deviceId);
+                }
+                config->buildIndex();
+                // create Port objects in devices
+                for(auto[num, ports] : portNums) {
+                    config->getDevice(num)->AddPorts(ports);
+                }
+                resourcesDone = true;
+            } else if(isInside(stack, {"afdxxml", "virtualLinks"}) && scanner.name == "virtualLink") {
+                if(!scanner.isEnd) {
+                    if(!resourcesDone) {
+                        throw std::runtime_error("virtual links before resources");
+                    }
+                    number = ParseInt(scanner.requireAttribute("number"));
+                    srcId = ParseInt(scanner.requireAttribute("source"));
+                    bag = ParseInt(scanner.requireAttribute("bag"));
+                    lmax = ParseInt(scanner.requireAttribute("lmax"));
+                    smax = lmax;
+                    if(loadFactor != 1.0) {
+                        smax = static_cast<int>(smax * loadFactor);
+                    }
+                    auto jitStr = scanner.attribute("jitStart"); // in us
+                    jitStart = jitStr.data() ? ParseFloat(jitStr) : NAN;
+                    jit0 = (jitStr.data() ? jitStart : jitDefaultValue) / 1e3; // in ms
+                    paths.clear();
+                }
+                if(scanner.isEnd || scanner.isEmpty) {
+                    int smin = std::min(sminDefault, smax);
+                    config->vlinks[number] = std::make_unique<Vlink>(config.get(), number, srcId, paths, bag, smax, smin, jit0);
+                    config->vlinks[number]->lmax = lmax;
+                    config->vlinks[number]->jitStart = jitStart;
+                }
+            } else if(!scanner.isEnd && isInside(stack, {"afdxxml", "virtualLinks", "virtualLink"}) && scanner.name == "path") {
+                std::vector<int> path;
+                ParseIntList(scanner.requireAttribute("path"), path);
+                assert(!path.empty());
+                paths.push_back(std::move(path));
+            }
+            if(!scanner.isEnd && !scanner.isEmpty) {
+                stack.push_back(scanner.name);
+            }
+        }
+        if(scanner.failed()) {
+            throw std::runtime_error("bad xml at offset " + std::to_string(scanner.offset()));
+        }
+        if(!resourcesDone) {
+            throw std::runtime_error("no resources");
+        }
+        assert(!config->vlinks.empty());
+        config->buildVlinkIndex();
+    } catch(std::exception& e) {
+        fprintf(stderr, "exception while reading vl config: %s\n", e.what());
+        return nullptr;
+    };
+    printf("%ld vlinks\n", config->vlinks.size());
+    return config;
+}
+
+// writes the current tag of scanner with new values of some attributes
+class TagWriter
+{
+public:
+    TagWriter(std::string_view text, const XmlScanner& scanner) : text(text), scanner(scanner) {}
+
+    void set(std::string_view name, const std::string& value) {
+        for(size_t i = 0; i < scanner.attributes.size(); i++) {
+            if(scanner.attributes[i].name == name) {
+                replaced.emplace_back(i, value);
+                return;
+            }
+        }
+        appended += " " + std::string(name) + "=\"" + value + "\"";
+    }
+
+    void write(FILE* fp) const {
+        size_t pos = scanner.tagBegin;
+        for(auto& [i, value]: replaced) {
+            size_t valueBegin = scanner.attributes[i].value.data() - text.data();
+            fwrite(text.data() + pos, 1, valueBegin - pos, fp);
+            fwrite(value.data(), 1, value.size(), fp);
+            pos = valueBegin + scanner.attributes[i].value.size();
+        }
+        fwrite(text.data() + pos, 1, scanner.attributesEnd - pos, fp);
+        fwrite(appended.data(), 1, appended.size(), fp);
+        fwrite(text.data() + scanner.attributesEnd, 1, scanner.tagEnd - scanner.attributesEnd, fp);
+    }
+
+private:
+    std::string_view text;
+    const XmlScanner& scanner;
+    std::vector<std::pair<size_t, std::string>> replaced; // in order of attributes
+    std::string appended;
+};
+
+bool toXmlText(VlinkConfig* config, std::string_view text, FILE* fp) {
+    try {
+        Vlink* vl = nullptr;
+        std::vector<std::string_view> stack;
+        size_t copied = 0;
+        XmlScanner scanner(text);
+        while(scanner.next()) {
+            if(scanner.isEnd) {
+                stack.pop_back();
+                continue;
+            }
+            TagWriter writer(text, scanner);
+            bool changed = true;
+            if(isInside(stack, {"afdxxml", "resources"}) && scanner.name == "link") {
+                if(ParseFloat(scanner.requireAttribute("capacity")) != config->linkRate) {
+                    writer.set("capacity", std::to_string(config->linkRate));
+                }
+            } else if(isInside(stack, {"afdxxml", "resources"}) && scanner.name == "switch") {
+                writer.set("scheme", config->scheme);
+            } else if(isInside(stack, {"afdxxml", "virtualLinks"}) && scanner.name == "virtualLink") {
+                vl = config->getVlink(ParseInt(scanner.requireAttribute("number")));
+                if(ParseInt(scanner.requireAttribute("lmax")) != vl->smax) {
+                    writer.set("lmax", std::to_string(vl->smax));
+                }
+                writer.set("lmin", std::to_string(vl->smin));
+            } else if(isInside(stack, {"afdxxml", "virtualLinks", "virtualLink"}) && scanner.name == "path") {
+                int deviceId = ParseInt(scanner.requireAttribute("dest"));
+                auto found = vl->dst.find(deviceId);
+                assert(found != vl->dst.end());
+                Vnode* vnode = found->second;
+                writer.set("maxDelay", std::to_string(
+                        static_cast<int>(ceil(1000. * config->linkByte2ms(vnode->e2e.dmax())))));
+                writer.set("maxJit", std::to_string(
+                        static_cast<int>(ceil(1000. * config->linkByte2ms(vnode->e2e.jit())))));
+            } else {
+                changed = false;
+            }
+            if(changed) {
+                fwrite(text.data() + copied, 1, scanner.tagBegin - copied, fp);
+                writer.write(fp);
+                copied = scanner.tagEnd;
+            }
+            if(!scanner.isEmpty) {
+                stack.push_back(scanner.name);
+            }
+        }
+        if(scanner.failed()) {
+            return false;
+        }
+        fwrite(text.data() + copied, 1, text.size() - copied, fp);
+    } catch(std::exception& e) {
+        fprintf(stderr, "exception while writing results: %s\n", e.what());
+        return false;
+    }
+    return true;
+}
+
 stats_t getStats(std::map<int, double> data) {
     assert(!data.empty());
     double min = data.begin()->second;
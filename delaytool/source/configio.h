@@ -2,6 +2,7 @@
 #ifndef DELAYTOOL_CONFIGIO_H
 #define DELAYTOOL_CONFIGIO_H
 
+#include <string_view>
 #include "tinyxml2/tinyxml2.h"
 #include "algo.h"
 
@@ -10,18 +11,68 @@ constexpr int sminDefault = 64; // bytes
 constexpr uint64_t bpMaxIterDefault = 100000;
 constexpr uint64_t cyclicMaxIterDefault = 100;
 constexpr int nFabricsDefault = 8;
+constexpr int nQueuesDefault = 2;
 
-std::vector<int> TokenizeCsv(const std::string& str);
+// integers separated by commas and/or spaces
+std::vector<int> TokenizeCsv(std::string_view str);
+
+// same as TokenizeCsv, appended to res
+void ParseIntList(std::string_view str, std::vector<int>& res);
+
+// number at the beginning of str (after spaces) like std::stoi and std::stof,
+// throws std::invalid_argument if there is none
+int ParseInt(std::string_view str);
+float ParseFloat(std::string_view str);
+
+// read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& fileName);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // false if the file can't be opened or mapped, or is empty
+    bool ok() const { return addr != nullptr; }
+
+    std::string_view text() const { return {static_cast<const char*>(addr), size}; }
+
+private:
+    void* addr;
+    size_t size;
+};
 
 VlinkConfigOwn fromXml(tinyxml2::XMLDocument& doc, const std::string& scheme,
         double jitDefaultValue = jitStartDefault, int forceLinkRate = 0,
         double loadFactor = 1., uint64_t bpMaxIter = bpMaxIterDefault,
-        uint64_t cyclicMaxIter = cyclicMaxIterDefault, int nFabrics = nFabricsDefault);
+        uint64_t cyclicMaxIter = cyclicMaxIterDefault, int nFabrics = nFabricsDefault,
+        int nQueues = nQueuesDefault);
 
 // doc must already contain the resources and VL configuration
 // (e.g. doc used for building config)
 bool toXml(VlinkConfig* config, tinyxml2::XMLDocument& doc);
 
+// sets smax, smin and start jitters of all VLs as if config was read with these loadFactor and jitDefaultValue
+void applyLoad(VlinkConfig* config, double loadFactor, double jitDefaultValue);
+
+// same for one VL
+void applyLoad(Vlink* vl, double loadFactor, double jitDefaultValue);
+
+// same as fromXml, but parses xml text in one pass without building a document
+VlinkConfigOwn fromXmlText(std::string_view text, const std::string& scheme,
+        double jitDefaultValue = jitStartDefault, int forceLinkRate = 0,
+        double loadFactor = 1., uint64_t bpMaxIter = bpMaxIterDefault,
+        uint64_t cyclicMaxIter = cyclicMaxIterDefault, int nFabrics = nFabricsDefault,
+        int nQueues = nQueuesDefault);
+
+// copy of text (the one config is built from by fromXmlText) to fp with the same changes
+// as made by fromXml and toXml in the document
+bool toXmlText(VlinkConfig* config, std::string_view text, FILE* fp);
+
 struct stats_t {double min, max, mean, var;};
 
 stats_t getStats(std::map<int, double> data);
@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <climits>
+#include "incremental.h"
+#include "configio.h"
+
+IncrementalAnalysis::IncrementalAnalysis(VlinkConfig* config, double loadFactor, double jitDefaultValue)
+    : config(config), loadFactor(loadFactor), jitDefaultValue(jitDefaultValue), analyzed(false), n_recalculated(0) {}
+
+Error IncrementalAnalysis::analyze(bool print, ResultSink* sink) {
+    edited.clear();
+    dropped.clear();
+    droppedTasks.clear();
+    dirty.clear();
+    Error err = config->buildTables();
+    if(!err) {
+        err = config->calcDelays(print, sink);
+    }
+    n_recalculated = config->tasks.size();
+    analyzed = !err;
+    return err;
+}
+
+std::string IncrementalAnalysis::checkVlink(const VlinkSpec& spec) const {
+    if(spec.bag <= 0 || spec.lmax <= 0) {
+        return "bag and lmax must be positive";
+    }
+    auto src = config->devices.find(spec.srcId);
+    if(src == config->devices.end() || src->second->type != Device::End) {
+        return "source must be an end system";
+    }
+    if(spec.paths.empty()) {
+        return "no paths";
+    }
+    std::map<int, int> inPorts; // device id -> input port of the VL in it, the same for all paths
+    for(const auto& path: spec.paths) {
+        if(path.empty()) {
+            return "empty path";
+        }
+        std::set<int> pathDevices = {spec.srcId};
+        int prevDeviceId = spec.srcId;
+        for(size_t i = 0; i < path.size(); i++) {
+            int portId = path[i];
+            if(config->_portDevice.count(portId) == 0 || config->links.count(portId) == 0) {
+                return "unknown port " + std::to_string(portId);
+            }
+            if(config->portDevice(config->connectedPort(portId)) != prevDeviceId) {
+                return "port " + std::to_string(portId) + " is not connected with device " +
+                       std::to_string(prevDeviceId);
+            }
+            int deviceId = config->portDevice(portId);
+            auto type = config->getDevice(deviceId)->type;
+            if((i + 1 < path.size()) != (type == Device::Switch)) {
+                return "path must go through switches to an end system";
+            }
+            if(!pathDevices.insert(deviceId).second) {
+                return "path visits device " + std::to_string(deviceId) + " twice";
+            }
+            auto [found, inserted] = inPorts.emplace(deviceId, portId);
+            if(!inserted && found->second != portId) {
+                return "paths enter device " + std::to_string(deviceId) + " through different ports";
+            }
+            prevDeviceId = deviceId;
+        }
+    }
+    return "";
+}
+
+DelayTask* IncrementalAnalysis::resolve(const TaskId& id, const TaskRef& ref) const {
+    if(dropped.count(ref.deviceId) == 0) {
+        return ref.task;
+    }
+    auto found = droppedTasks.find(id);
+    return found != droppedTasks.end() ? found->second.replacement : nullptr;
+}
+
+void IncrementalAnalysis::dropDeviceTasks(Device* device) {
+    if(!analyzed || !dropped.insert(device->id).second) {
+        return;
+    }
+    // entries of the removed tasks in maps of the other tasks are set to null instead of erasing,
+    // the new tasks take them again without allocating memory of other devices
+    auto vnodes = device->getHopVnodes();
+    for(auto vnode: vnodes) {
+        for(const auto& [_, delayTaskOwn]: vnode->delayTasks) {
+            auto delayTask = delayTaskOwn.get();
+            auto& saved = droppedTasks[delayTask->id];
+            saved.delay = delayTask->delay;
+            for(auto [key, input]: delayTask->inputs) {
+                saved.inputKeys.push_back(key);
+                // null if the input is from a device dropped before
+                if(input != nullptr) {
+                    saved.producers.push_back({input, input->device->id});
+                    input->output_for[{delayTask->vl->id, delayTask->out_pseudo_id}] = nullptr;
+                }
+            }
+            // a task is in inputs of another one under keys with its VL id, for some branches
+            for(auto [_, consumer]: delayTask->output_for) {
+                if(consumer == nullptr) {
+                    continue;
+                }
+                auto& inputs = consumer->inputs;
+                for(auto it = inputs.lower_bound({delayTask->vl->id, INT_MIN});
+                    it != inputs.end() && it->first.first == delayTask->vl->id; ++it) {
+                    if(it->second == delayTask) {
+                        saved.consumers.emplace_back(TaskRef{consumer, consumer->device->id}, it->first);
+                        it->second = nullptr;
+                    }
+                }
+            }
+        }
+    }
+    for(auto vnode: vnodes) {
+        config->n_tasks -= static_cast<int>(vnode->delayTasks.size());
+        vnode->delayTasks.clear();
+    }
+    device->qrtas.clear();
+    device->releaseArena();
+}
+
+std::string IncrementalAnalysis::addVlink(const VlinkSpec& spec) {
+    if(config->vlinks.find(spec.id) != config->vlinks.end()) {
+        return "VL " + std::to_string(spec.id) + " already exists";
+    }
+    std::string err = checkVlink(spec);
+    if(!err.empty()) {
+        return err;
+    }
+    dropDeviceTasks(config->getDevice(spec.srcId));
+    for(const auto& path: spec.paths) {
+        for(int portId: path) {
+            dropDeviceTasks(config->getDevice(config->portDevice(portId)));
+        }
+    }
+    auto vl = std::make_unique<Vlink>(config, spec.id, spec.srcId, spec.paths, spec.bag, spec.lmax, 0, 0.);
+    vl->lmax = spec.lmax;
+    vl->jitStart = spec.jitStart;
+    applyLoad(vl.get(), loadFactor, jitDefaultValue);
+    config->addVlink(std::move(vl));
+    edited.insert(spec.id);
+    return "";
+}
+
+void IncrementalAnalysis::dropVlink(int id) {
+    std::vector<Vnode*> stack = {config->getVlink(id)->src.get()};
+    while(!stack.empty()) {
+        auto vnode = stack.back();
+        stack.pop_back();
+        dropDeviceTasks(vnode->device);
+        for(const auto& next: vnode->next) {
+            stack.push_back(next.get());
+        }
+    }
+    config->removeVlink(id);
+    edited.insert(id);
+}
+
+std::string IncrementalAnalysis::removeVlink(int id) {
+    if(config->vlinks.find(id) == config->vlinks.end()) {
+        return "no VL " + std::to_string(id);
+    }
+    if(config->vlinks.size() == 1) {
+        return "can't remove the last VL";
+    }
+    dropVlink(id);
+    return "";
+}
+
+std::string IncrementalAnalysis::modifyVlink(const VlinkSpec& spec) {
+    if(config->vlinks.find(spec.id) == config->vlinks.end()) {
+        return "no VL " + std::to_string(spec.id);
+    }
+    std::string err = checkVlink(spec);
+    if(!err.empty()) {
+        return err;
+    }
+    dropVlink(spec.id);
+    return addVlink(spec);
+}
+
+Error IncrementalAnalysis::update(bool print, ResultSink* sink) {
+    if(!analyzed) {
+        return analyze(print, sink);
+    }
+    n_recalculated = 0;
+    if(dropped.empty() && dirty.empty()) {
+        return Error::Success;
+    }
+    std::vector<Device*> devices;
+    for(int deviceId: dropped) {
+        devices.push_back(config->getDevice(deviceId));
+    }
+    for(auto device: devices) {
+        if(config->scheme == "CIOQ") {
+            config->buildTable(device);
+        }
+        config->createDeviceTasks(device);
+    }
+    for(auto device: devices) {
+        config->linkDeviceTasks(device);
+    }
+
+    // new tasks of edited VLs or with other inputs than before are recalculated
+    // with all tasks depending on them, the other new ones get their previous delays
+    std::vector<DelayTask*> touched;
+    for(auto device: devices) {
+        for(auto vnode: device->getHopVnodes()) {
+            for(const auto& [_, delayTaskOwn]: vnode->delayTasks) {
+                auto delayTask = delayTaskOwn.get();
+                auto found = droppedTasks.find(delayTask->id);
+                if(found != droppedTasks.end()) {
+                    found->second.replacement = delayTask;
+                }
+                bool same = found != droppedTasks.end() && edited.count(delayTask->vl->id) == 0 &&
+                        found->second.inputKeys.size() == delayTask->inputs.size() &&
+                        std::equal(found->second.inputKeys.begin(), found->second.inputKeys.end(),
+                                   delayTask->inputs.begin(),
+                                   [](const auto& key, const auto& input) { return key == input.first; });
+                if(same) {
+                    delayTask->delay = found->second.delay;
+                } else {
+                    touched.push_back(delayTask);
+                }
+            }
+        }
+    }
+    // tasks of other devices get the new tasks as inputs instead of the removed ones,
+    // and entries left null are erased
+    for(const auto& [id, saved]: droppedTasks) {
+        auto delayTask = saved.replacement;
+        for(const auto& [consumerRef, key]: saved.consumers) {
+            if(dropped.count(consumerRef.deviceId) > 0) {
+                continue;
+            }
+            auto consumer = consumerRef.task;
+            if(delayTask != nullptr) {
+                consumer->inputs[key] = delayTask;
+                delayTask->output_for[{consumer->vl->id, consumer->out_pseudo_id}] = consumer;
+            } else {
+                consumer->inputs.erase(key);
+                touched.push_back(consumer);
+            }
+            consumer->qrta->resetInputs();
+        }
+        for(const auto& producerRef: saved.producers) {
+            if(dropped.count(producerRef.deviceId) > 0) {
+                continue;
+            }
+            auto producer = producerRef.task;
+            auto found = producer->output_for.find({std::get<0>(id), std::get<1>(id)});
+            if(found != producer->output_for.end() && found->second == nullptr) {
+                producer->output_for.erase(found);
+            }
+        }
+    }
+    for(const auto& [id, ref]: dirty) {
+        if(auto delayTask = resolve(id, ref)) {
+            touched.push_back(delayTask);
+        }
+    }
+    edited.clear();
+    dropped.clear();
+    droppedTasks.clear();
+    dirty.clear();
+
+    std::set<DelayTask*> affected;
+    std::vector<DelayTask*> subset;
+    for(auto delayTask: touched) {
+        if(affected.insert(delayTask).second) {
+            subset.push_back(delayTask);
+        }
+    }
+    for(size_t i = 0; i < subset.size(); i++) {
+        for(auto [_, consumer]: subset[i]->output_for) {
+            if(affected.insert(consumer).second) {
+                subset.push_back(consumer);
+            }
+        }
+    }
+    n_recalculated = subset.size();
+    if(subset.empty()) {
+        return Error::Success;
+    }
+    Error err = config->calcTasksOf(subset, print, sink);
+    if(err) {
+        for(auto delayTask: subset) {
+            dirty.push_back({delayTask->id, {delayTask, delayTask->device->id}});
+        }
+    }
+    return err;
+}
@@ -0,0 +1,96 @@
+#pragma once
+#ifndef DELAYTOOL_INCREMENTAL_H
+#define DELAYTOOL_INCREMENTAL_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <tuple>
+#include <cmath>
+#include "algo.h"
+
+// VL as given in input: paths are lists of input port ids from the source to destinations
+struct VlinkSpec {
+    int id = -1;
+    int srcId = -1;
+    std::vector<std::vector<int>> paths;
+    int bag = 0; // in ms
+    int lmax = 0; // in bytes
+    double jitStart = NAN; // in us, NaN for the default one
+};
+
+// re-analysis of a config after adding, removing or modifying single VLs.
+// an edit removes delay tasks and QRTAs of all devices on the old and new routes of the VL,
+// update() creates them again (with CIOQ tables of these devices) and recalculates only the tasks
+// reachable through output_for from the new ones whose VL or inputs have changed.
+// the other tasks of these devices get their previous delays, and the rest of the network is not visited
+class IncrementalAnalysis
+{
+public:
+    // loadFactor and jitDefaultValue are the ones config is read with, they are applied to new VLs
+    IncrementalAnalysis(VlinkConfig* config, double loadFactor, double jitDefaultValue);
+
+    // builds CIOQ tables and calculates all delays
+    Error analyze(bool print = false, ResultSink* sink = nullptr);
+
+    // edits return an empty string if they are applied, or the reason why the edit is wrong
+    std::string addVlink(const VlinkSpec& spec);
+
+    std::string removeVlink(int id);
+
+    // replace VL spec.id by spec
+    std::string modifyVlink(const VlinkSpec& spec);
+
+    // recalculates delays affected by edits since the previous update(), or all of them if there was
+    // no successful analyze(). only destinations with recalculated delays are printed and passed to sink.
+    // if it fails, the tasks it tried to calculate are recalculated by the next update()
+    Error update(bool print = false, ResultSink* sink = nullptr);
+
+    bool hasEdits() const { return !edited.empty(); }
+
+    // number of tasks calculated by the last analyze() or update()
+    size_t lastRecalculated() const { return n_recalculated; }
+
+private:
+    using TaskId = std::tuple<int, int, Device::elem_t>; // as DelayTask::id
+
+    // task of another device, it exists while the device is not dropped
+    struct TaskRef {
+        DelayTask* task;
+        int deviceId;
+    };
+
+    // state of a removed task, to be compared with the new one
+    struct DroppedTask {
+        DelayData delay;
+        std::vector<std::pair<int, int>> inputKeys; // sorted
+        std::vector<TaskRef> producers; // tasks having this one in output_for
+        // tasks having this one in inputs, with its key there
+        std::vector<std::pair<TaskRef, std::pair<int, int>>> consumers;
+        DelayTask* replacement = nullptr; // new task with the same id, set by update()
+    };
+
+    VlinkConfig* const config;
+    const double loadFactor;
+    const double jitDefaultValue;
+    bool analyzed; // all delays are calculated once
+    std::set<int> edited; // ids of VLs added, removed or modified since the last update()
+    std::set<int> dropped; // ids of devices whose tasks are removed since the last update()
+    std::map<TaskId, DroppedTask> droppedTasks;
+    std::vector<std::pair<TaskId, TaskRef>> dirty; // tasks of a failed update()
+    size_t n_recalculated;
+
+    std::string checkVlink(const VlinkSpec& spec) const;
+
+    // removes delay tasks and QRTAs of device, keeping the other tasks consistent
+    void dropDeviceTasks(Device* device);
+
+    // removes existing VL with its tasks
+    void dropVlink(int id);
+
+    // the task, or the new one with its id if its device is dropped, nullptr if there is no such task now
+    DelayTask* resolve(const TaskId& id, const TaskRef& ref) const;
+};
+
+#endif //DELAYTOOL_INCREMENTAL_H
@@ -1,9 +1,15 @@
 #include <iostream>
 #include <cstdio>
 #include <string>
+#include <sstream>
 #include "tinyxml2/tinyxml2.h"
 #include "argparse/argparse.hpp"
 #include "configio.h"
+#include "configbin.h"
+#include "resultwriter.h"
+#include "batch.h"
+#include "server.h"
+#include "stats.h"
 #include "algo.h"
 
 std::string strToLower(const std::string& str) {
@@ -14,14 +20,363 @@ std::string strToLower(const std::string& str) {
     return str2;
 }
 
+// options of the analysis common for single runs and batch mode
+void addAnalysisArguments(argparse::ArgumentParser& program) {
+    program.add_argument("-r", "--rate")
+            .action([](const std::string& value) { return std::stoi(value); })
+            .default_value(0)
+            .help("change (force) link rate to specified value, in byte/ms");
+
+    program.add_argument("--nqueues")
+            .help("number of virtual input queues per port for CIOQ scheme, must divide number of fabrics (default: 2)")
+            .action([](const std::string& value) { return std::stoi(value); })
+            .default_value(nQueuesDefault);
+
+    program.add_argument("--bpmaxit")
+            .action([](const std::string& value) { return static_cast<uint64_t>(std::stof(value)); })
+            .default_value(static_cast<uint64_t>(bpMaxIterDefault))
+            .help(std::string("max number of iterations of calculating busy period.\n")
+                  + "its calculation won't be endless because its parameters are checked for a sign of this earlier,"
+                  + "but it may take too long. set 0 for no restrictions.");
+
+    program.add_argument("--cycmaxit")
+            .action([](const std::string& value) { return static_cast<uint64_t>(std::stof(value)); })
+            .default_value(static_cast<uint64_t>(cyclicMaxIterDefault))
+            .help(std::string("max number of iterations for calculating delays if the data dependencies are cyclic.\n")
+                  + "set 0 for no restrictions.");
+
+    program.add_argument("--bpsolver")
+            .help("method of busy period calculation: iter|accel (default: iter).\n"
+                  "accel gives the same results as iter in much less iterations if link load is high")
+            .default_value(VlinkConfig::BpIter)
+            .action([](const std::string& value) {
+                static const std::map<std::string, VlinkConfig::bp_solver_t> mapping = {
+                        {"iter", VlinkConfig::BpIter},
+                        {"accel", VlinkConfig::BpAccel},
+                };
+                auto found = mapping.find(strToLower(value));
+                if(found != mapping.end()) {
+                    return found->second;
+                } else {
+                    throw std::runtime_error("invalid value of --bpsolver");
+                }
+            });
+
+    program.add_argument("--cyclic")
+            .help("method of iteration over cyclic dependent delays: sweep|worklist (default: sweep).\n"
+                  "worklist recalculates a delay only when its input delays have changed")
+            .default_value(VlinkConfig::CyclicSweep)
+            .action([](const std::string& value) {
+                static const std::map<std::string, VlinkConfig::cyclic_solver_t> mapping = {
+                        {"sweep", VlinkConfig::CyclicSweep},
+                        {"worklist", VlinkConfig::CyclicWorklist},
+                };
+                auto found = mapping.find(strToLower(value));
+                if(found != mapping.end()) {
+                    return found->second;
+                } else {
+                    throw std::runtime_error("invalid value of --cyclic");
+                }
+            });
+
+    program.add_argument("--widen")
+            .implicit_value(true)
+            .default_value(false)
+            .help("extrapolate slowly growing jitters in cyclic iterations (sweep and worklist),\n"
+                  "results are upper bounds of the iterated ones");
+
+    program.add_argument("--cioqmap")
+            .help("CIOQ queue and fabric mapping of switches: basic|balanced (default: basic).\n"
+                  "balanced minimizes maximum load of fabric components")
+            .default_value(VlinkConfig::CioqMapBasic)
+            .action([](const std::string& value) {
+                static const std::map<std::string, VlinkConfig::cioq_mapper_t> mapping = {
+                        {"basic", VlinkConfig::CioqMapBasic},
+                        {"balanced", VlinkConfig::CioqMapBalanced},
+                };
+                auto found = mapping.find(strToLower(value));
+                if(found != mapping.end()) {
+                    return found->second;
+                } else {
+                    throw std::runtime_error("invalid value of --cioqmap");
+                }
+            });
+
+    program.add_argument("--threads")
+            .help("number of threads for calculating delays (default: 1)")
+            .action([](const std::string& value) { return std::stoi(value); })
+            .default_value(1);
+}
+
+// comma separated values converted by conv
+template<typename T, typename Conv>
+std::vector<T> parseList(const std::string& str, Conv conv) {
+    std::vector<T> res;
+    std::stringstream ss(str);
+    std::string item;
+    while(std::getline(ss, item, ',')) {
+        if(!item.empty()) {
+            res.push_back(conv(item));
+        }
+    }
+    if(res.empty()) {
+        throw std::runtime_error("empty list");
+    }
+    return res;
+}
+
+// delaytool batch [sweep options] output.csv input...
+int batchMain(int argc, char* argv[]) {
+    argparse::ArgumentParser program("delaytool batch");
+
+    program.add_argument("output")
+            .help("output csv file with one row for every combination of parameters,\n"
+                  "in the same format as experiments.py writes");
+
+    program.add_argument("input")
+            .help("input xml or binary files with network resources and virtual links, or their\n"
+                  "wildcard patterns like 'vlconfigs/msggen*/*_final_vls_*.xml' (after all options)")
+            .remaining();
+
+    program.add_argument("--jobs")
+            .help("number of input files evaluated concurrently (default: 1)")
+            .default_value(1)
+            .action([](const std::string& value) { return std::stoi(value); });
+
+    program.add_argument("-s", "--scheme")
+            .help("comma separated scheme names: oq|cioq (default: cioq)")
+            .default_value(std::string("cioq"));
+
+    program.add_argument("--nfabrics")
+            .help("comma separated numbers of fabrics for CIOQ scheme (default: 8)")
+            .default_value(std::to_string(nFabricsDefault));
+
+    program.add_argument("-f", "--factor")
+            .help("comma separated factors of max packet size for all VLs (default: 1)")
+            .default_value(std::string("1"));
+
+    program.add_argument("-b", "--bw")
+            .help("comma separated values of maximum link bandwidth usage, instead of --factor,\n"
+                  "factor is bw divided by the maximum usage with factor 1")
+            .default_value(std::string(""));
+
+    program.add_argument("--avg")
+            .implicit_value(true)
+            .default_value(false)
+            .help("values of --bw are average link bandwidth usage instead of maximum,\n"
+                  "bw column of rows with --factor is the average usage too");
+
+    program.add_argument("-j", "--jitdef")
+            .help("comma separated default start jitters in microseconds (default: 500)")
+            .default_value(std::to_string(jitStartDefault));
+
+    addAnalysisArguments(program);
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        std::cout << program;
+        return 0;
+    }
+
+    SweepSpec sweep;
+    try {
+        auto toDouble = [](const std::string& item) { return std::stod(item); };
+        sweep.schemes = parseList<std::string>(program.get<std::string>("--scheme"), [](const std::string& item) {
+            auto scheme = strToLower(item);
+            if(scheme != "oq" && scheme != "cioq") {
+                throw std::runtime_error("invalid value of -s");
+            }
+            return scheme == "oq" ? std::string("OQ") : std::string("CIOQ");
+        });
+        sweep.nFabrics = parseList<int>(program.get<std::string>("--nfabrics"),
+                                        [](const std::string& item) { return std::stoi(item); });
+        sweep.byBw = !program.get<std::string>("--bw").empty();
+        sweep.byMax = !program.get<bool>("--avg");
+        sweep.loads = parseList<double>(program.get<std::string>(sweep.byBw ? "--bw" : "--factor"), toDouble);
+        sweep.jitDefs = parseList<double>(program.get<std::string>("--jitdef"), toDouble);
+    } catch (const std::exception& err) {
+        std::cout << program;
+        return 0;
+    }
+    BatchOptions options;
+    options.forceLinkRate = program.get<int>("--rate");
+    options.bpMaxIter = program.get<uint64_t>("--bpmaxit");
+    options.cyclicMaxIter = program.get<uint64_t>("--cycmaxit");
+    options.nQueues = program.get<int>("--nqueues");
+    options.bpSolver = program.get<VlinkConfig::bp_solver_t>("--bpsolver");
+    options.cyclicSolver = program.get<VlinkConfig::cyclic_solver_t>("--cyclic");
+    options.cyclicWiden = program.get<bool>("--widen");
+    options.cioqMapper = program.get<VlinkConfig::cioq_mapper_t>("--cioqmap");
+    options.n_threads = program.get<int>("--threads");
+    for(int nFabrics: sweep.nFabrics) {
+        if(options.nQueues <= 0 || nFabrics <= 0 || nFabrics % options.nQueues != 0) {
+            fprintf(stderr, "error: number of fabrics must be a positive multiple of number of queues\n");
+            return 0;
+        }
+    }
+
+    std::vector<std::string> filesIn;
+    try {
+        filesIn = expandInputs(program.get<std::vector<std::string>>("input"));
+    } catch (const std::exception& err) {
+        std::cout << program;
+        return 0;
+    }
+    int nJobs = program.get<int>("--jobs");
+    std::string fileOut = program.get<std::string>("output");
+    FILE *fpOut = fopen(fileOut.c_str(), "w");
+    if(fpOut == nullptr) {
+        fprintf(stderr, "error: can't open output file: %s\n", fileOut.c_str());
+        return 0;
+    }
+    fputs(batchCsvHeader().c_str(), fpOut);
+    runBatchFiles(filesIn, sweep, options, nJobs, [fpOut](const std::string& row) {
+        fputs(row.c_str(), fpOut);
+        fflush(fpOut);
+    });
+    fclose(fpOut);
+    return 0;
+}
+
+// delaytool serve [options] socket
+int serveMain(int argc, char* argv[]) {
+    argparse::ArgumentParser program("delaytool serve");
+
+    program.add_argument("socket")
+            .help("path of unix domain socket to listen on for requests, one per line:\n"
+                  "load <file>, evaluate, add|modify <id> <source> <bag> <lmax> <path>[;<path>...] [<jitStart>],\n"
+                  "remove <id>, e2e <vl> <dest>, dump, shutdown. responses are json lines");
+
+    program.add_argument("--load")
+            .help("input xml or binary file loaded and analyzed before serving requests")
+            .default_value(std::string(""));
+
+    program.add_argument("-s", "--scheme")
+            .help("scheme name: oq|cioq (default: cioq)")
+            .default_value(std::string("CIOQ"))
+            .action([](const std::string& value) {
+                static const std::map<std::string, std::string> mapping = {
+                        {"oq", "OQ"},
+                        {"cioq", "CIOQ"},
+                };
+                auto found = mapping.find(strToLower(value));
+                if(found != mapping.end()) {
+                    return found->second;
+                } else {
+                    throw std::runtime_error("invalid value of -s");
+                }
+            });
+
+    program.add_argument("--nfabrics")
+            .help("number of fabrics for CIOQ scheme (default: 8)")
+            .action([](const std::string& value) { return std::stoi(value); })
+            .default_value(nFabricsDefault);
+
+    program.add_argument("-f", "--factor")
+            .action([](const std::string& value) { return std::stod(value); })
+            .default_value(1.)
+            .help("multiply max packet size for all VLs by factor (and cast to integer)");
+
+    program.add_argument("-j", "--jitdef")
+            .action([](const std::string& value) { return std::stod(value); })
+            .default_value(static_cast<double>(jitStartDefault))
+            .help("default start jitter in microseconds if not specified in input data (default: 500)");
+
+    addAnalysisArguments(program);
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        std::cout << program;
+        return 0;
+    }
+
+    ServerOptions options;
+    options.scheme = program.get<std::string>("--scheme");
+    options.nFabrics = program.get<int>("--nfabrics");
+    options.loadFactor = program.get<double>("--factor");
+    options.jitDefault = program.get<double>("--jitdef");
+    options.analysis.forceLinkRate = program.get<int>("--rate");
+    options.analysis.bpMaxIter = program.get<uint64_t>("--bpmaxit");
+    options.analysis.cyclicMaxIter = program.get<uint64_t>("--cycmaxit");
+    options.analysis.nQueues = program.get<int>("--nqueues");
+    options.analysis.bpSolver = program.get<VlinkConfig::bp_solver_t>("--bpsolver");
+    options.analysis.cyclicSolver = program.get<VlinkConfig::cyclic_solver_t>("--cyclic");
+    options.analysis.cyclicWiden = program.get<bool>("--widen");
+    options.analysis.cioqMapper = program.get<VlinkConfig::cioq_mapper_t>("--cioqmap");
+    options.analysis.n_threads = program.get<int>("--threads");
+    if(options.analysis.nQueues <= 0 || options.nFabrics <= 0 || options.nFabrics % options.analysis.nQueues != 0) {
+        fprintf(stderr, "error: number of fabrics must be a positive multiple of number of queues\n");
+        return 0;
+    }
+
+    AnalysisServer server(options);
+    std::string fileIn = program.get<std::string>("--load");
+    if(!fileIn.empty()) {
+        server.handle("load " + fileIn, stdout);
+    }
+    server.run(program.get<std::string>("socket"));
+    return 0;
+}
+
+// delaytool convert input.xml output.bin
+int convertMain(int argc, char* argv[]) {
+    argparse::ArgumentParser program("delaytool convert");
+
+    program.add_argument("input")
+            .help("input xml file with network resources and virtual links");
+
+    program.add_argument("output")
+            .help("output binary file with the same resources and virtual links, "
+                  "it can be used as input of delaytool instead of the xml file");
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        std::cout << program;
+        return 0;
+    }
+
+    std::string fileIn = program.get<std::string>("input");
+    std::string fileOut = program.get<std::string>("output");
+    MappedFile input(fileIn);
+    if(!input.ok()) {
+        fprintf(stderr, "error: can't load input file: %s\n", fileIn.c_str());
+        return 0;
+    }
+    FILE *fpOut = fopen(fileOut.c_str(), "wb");
+    if(fpOut == nullptr) {
+        fprintf(stderr, "error: can't open output file: %s\n", fileOut.c_str());
+        return 0;
+    }
+    if(!xmlToBin(input.text(), fpOut)) {
+        fprintf(stderr, "error converting to binary config\n");
+    }
+    fclose(fpOut);
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
+    if(argc >= 2 && std::string(argv[1]) == "convert") {
+        return convertMain(argc - 1, argv + 1);
+    }
+    if(argc >= 2 && std::string(argv[1]) == "batch") {
+        return batchMain(argc - 1, argv + 1);
+    }
+    if(argc >= 2 && std::string(argv[1]) == "serve") {
+        return serveMain(argc - 1, argv + 1);
+    }
+
     argparse::ArgumentParser program("delaytool");
 
     program.add_argument("input")
-            .help("input xml file with network resources and virtual links");
+            .help("input xml file with network resources and virtual links,\n"
+                  "or binary file made from it by 'delaytool convert'");
 
     program.add_argument("output")
-            .help("output xml file with delays of all VLs to all their destinations");
+            .help("output xml file with delays of all VLs to all their destinations\n"
+                  "(for binary input, it contains only VLs and their paths)");
 
     program.add_argument("-s", "--scheme")
             .help("scheme name: oq|cioq (default: cioq)")
@@ -44,6 +399,37 @@ int main(int argc, char* argv[]) {
             .action([](const std::string& value) { return std::stoi(value); })
             .default_value(nFabricsDefault);
 
+    program.add_argument("--loader")
+            .help("input xml loader: dom|stream (default: dom).\n"
+                  "stream parses the input in one pass without building a document and writes the output\n"
+                  "as a copy of the input with results, it needs much less time and memory for big inputs")
+            .default_value(std::string("dom"))
+            .action([](const std::string& value) {
+                auto loader = strToLower(value);
+                if(loader != "dom" && loader != "stream") {
+                    throw std::runtime_error("invalid value of --loader");
+                }
+                return loader;
+            });
+
+    program.add_argument("--outformat")
+            .help("output format: xml|csv|jsonl|bin (default: xml).\n"
+                  "csv, jsonl and bin contain only delays of VLs to their destinations,\n"
+                  "they are written as the delays are obtained")
+            .default_value(std::string("xml"))
+            .action([](const std::string& value) {
+                auto format = strToLower(value);
+                if(format != "xml" && format != "csv" && format != "jsonl" && format != "bin") {
+                    throw std::runtime_error("invalid value of --outformat");
+                }
+                return format;
+            });
+
+    program.add_argument("--stats")
+            .help("file to write json with wall and CPU time of analysis phases, counters of busy period\n"
+                  "iterations and QRTA evaluation points, and peak memory usage")
+            .default_value(std::string(""));
+
     program.add_argument("--printconfig")
             .implicit_value(true)
             .default_value(false)
@@ -69,28 +455,12 @@ int main(int argc, char* argv[]) {
             .default_value(static_cast<float>(jitStartDefault))
             .help("default start jitter in microseconds if not specified in input data (default: 500)");
 
-    program.add_argument("-r", "--rate")
-            .action([](const std::string& value) { return std::stoi(value); })
-            .default_value(0)
-            .help("change (force) link rate to specified value, in byte/ms");
-
     program.add_argument("-f", "--factor")
             .action([](const std::string& value) { return std::stof(value); })
             .default_value(1.f)
             .help("multiply max packet size for all VLs by factor (and cast to integer)");
 
-    program.add_argument("--bpmaxit")
-            .action([](const std::string& value) { return static_cast<uint64_t>(std::stof(value)); })
-            .default_value(static_cast<uint64_t>(bpMaxIterDefault))
-            .help(std::string("max number of iterations of calculating busy period.\n")
-                  + "its calculation won't be endless because its parameters are checked for a sign of this earlier,"
-                  + "but it may take too long. set 0 for no restrictions.");
-
-    program.add_argument("--cycmaxit")
-            .action([](const std::string& value) { return static_cast<uint64_t>(std::stof(value)); })
-            .default_value(static_cast<uint64_t>(cyclicMaxIterDefault))
-            .help(std::string("max number of iterations for calculating delays if the data dependencies are cyclic.\n")
-                  + "set 0 for no restrictions.");
+    addAnalysisArguments(program);
 
     try {
         program.parse_args(argc, argv);
@@ -102,9 +472,12 @@ int main(int argc, char* argv[]) {
     std::string fileIn = program.get<std::string>("input");
     std::string fileOut = program.get<std::string>("output");
     std::string scheme = program.get<std::string>("--scheme");
+    bool streamLoader = program.get<std::string>("--loader") == "stream";
+    std::string outFormat = program.get<std::string>("--outformat");
     float startJitDefault = program.get<float>("--jitdef");
     int forceLinkRate = program.get<int>("--rate");
     int nFabrics = program.get<int>("--nfabrics");
+    int nQueues = program.get<int>("--nqueues");
     float sizeFactor = program.get<float>("--factor");
     bool printConfig = program.get<bool>("--printconfig");
     bool printDelays = program.get<bool>("--printdelays");
@@ -112,25 +485,61 @@ int main(int argc, char* argv[]) {
     bool nocalc = program.get<bool>("--nocalc");
     uint64_t bpMaxIter = program.get<uint64_t>("--bpmaxit");
     uint64_t cyclicMaxIter = program.get<uint64_t>("--cycmaxit");
+    auto bpSolver = program.get<VlinkConfig::bp_solver_t>("--bpsolver");
+    auto cyclicSolver = program.get<VlinkConfig::cyclic_solver_t>("--cyclic");
+    bool cyclicWiden = program.get<bool>("--widen");
+    auto cioqMapper = program.get<VlinkConfig::cioq_mapper_t>("--cioqmap");
+    int nThreads = program.get<int>("--threads");
+    std::string statsFile = program.get<std::string>("--stats");
 
+    if(nQueues <= 0 || nFabrics <= 0 || nFabrics % nQueues != 0) {
+        fprintf(stderr, "error: number of fabrics must be a positive multiple of number of queues\n");
+        return 0;
+    }
+
+    AnalysisStats stats;
+    StatsFileWriter statsWriter(statsFile.empty() ? nullptr : &stats, statsFile);
+    PhaseTimer parseTimer(statsFile.empty() ? nullptr : &stats, AnalysisStats::Parse);
     tinyxml2::XMLDocument doc;
-    auto err = doc.LoadFile(fileIn.c_str());
-    if(err) {
-        fprintf(stderr, "error: can't load input file: %s\n", tinyxml2::XMLDocument::ErrorIDToName(err));
+    MappedFile input(fileIn);
+    if(!input.ok()) {
+        fprintf(stderr, "error: can't load input file: %s\n", fileIn.c_str());
         return 0;
     }
-    FILE *fpOut = fopen(fileOut.c_str(), "w");
+    std::string_view text = input.text();
+    bool binInput = isBinConfig(text);
+    if(!binInput && !streamLoader) {
+        auto err = doc.Parse(text.data(), text.size());
+        if(err) {
+            fprintf(stderr, "error: can't load input file: %s\n", tinyxml2::XMLDocument::ErrorIDToName(err));
+            return 0;
+        }
+    }
+    FILE *fpOut = fopen(fileOut.c_str(), outFormat == "bin" ? "wb" : "w");
     if(fpOut == nullptr) {
         fprintf(stderr, "error: can't open output file: %s\n", fileOut.c_str());
         return 0;
     }
-    VlinkConfigOwn config = fromXml(doc, scheme,
-            startJitDefault, forceLinkRate, sizeFactor, bpMaxIter, cyclicMaxIter, nFabrics);
+    VlinkConfigOwn config = binInput
+            ? fromBin(text, scheme,
+                    startJitDefault, forceLinkRate, sizeFactor, bpMaxIter, cyclicMaxIter, nFabrics, nQueues)
+            : streamLoader
+            ? fromXmlText(text, scheme,
+                    startJitDefault, forceLinkRate, sizeFactor, bpMaxIter, cyclicMaxIter, nFabrics, nQueues)
+            : fromXml(doc, scheme,
+                    startJitDefault, forceLinkRate, sizeFactor, bpMaxIter, cyclicMaxIter, nFabrics, nQueues);
     if(config == nullptr) {
         fprintf(stderr, "error reading from xml\n");
         fclose(fpOut);
         return 0;
     }
+    parseTimer.stop();
+    config->bpSolver = bpSolver;
+    config->cyclicSolver = cyclicSolver;
+    config->cyclicWiden = cyclicWiden;
+    config->cioqMapper = cioqMapper;
+    config->n_threads = std::max(nThreads, 1);
+    config->stats = statsFile.empty() ? nullptr : &stats;
     if(printConfig) {
         DebugInfo(config.get());
     }
@@ -158,8 +567,23 @@ int main(int argc, char* argv[]) {
         fprintf(stderr, "error calculating delay because of exception: %s\n", e.what());
     }
 
+    static const std::map<std::string, ResultWriter::format_t> resultFormats = {
+            {"csv", ResultWriter::Csv},
+            {"jsonl", ResultWriter::Jsonl},
+            {"bin", ResultWriter::Bin},
+    };
+    std::unique_ptr<ResultWriter> resultWriter;
+    if(outFormat != "xml") {
+        resultWriter = ResultWriter::create(resultFormats.at(outFormat), fpOut, config.get());
+        if(resultWriter == nullptr) {
+            fprintf(stderr, "error writing to output file: %s\n", fileOut.c_str());
+            fclose(fpOut);
+            return 0;
+        }
+    }
+
     try {
-        Error calcErr = config->calcDelays(printDelays);
+        Error calcErr = config->calcDelays(printDelays, resultWriter.get());
         if(calcErr) {
             fprintf(stderr, "error calculating delay, can't calculate delays on this network configuration: %s, %s\n",
                     calcErr.TypeString().c_str(), calcErr.Verbose().c_str());
@@ -169,13 +593,27 @@ int main(int argc, char* argv[]) {
     } catch(std::exception& e) {
         fprintf(stderr, "error calculating delay because of exception: %s\n", e.what());
     }
+    if(resultWriter != nullptr) {
+        if(resultWriter->failed()) {
+            fprintf(stderr, "error writing to output file: %s\n", fileOut.c_str());
+        }
+        fclose(fpOut);
+        return 0;
+    }
+    if(binInput || streamLoader) {
+        if(binInput ? !toXmlResults(config.get(), fpOut) : !toXmlText(config.get(), text, fpOut)) {
+            fprintf(stderr, "error converting to xml\n");
+        }
+        fclose(fpOut);
+        return 0;
+    }
     bool ok = toXml(config.get(), doc);
     if(!ok) {
         fprintf(stderr, "error converting to xml\n");
         fclose(fpOut);
         return 0;
     }
-    err = doc.SaveFile(fpOut, false);
+    auto err = doc.SaveFile(fpOut, false);
     if(err) {
         fprintf(stderr, "error writing to output file: %s\n", tinyxml2::XMLDocument::ErrorIDToName(err));
     }
@@ -0,0 +1,60 @@
+#include <cmath>
+#include <cstring>
+#include "resultwriter.h"
+
+std::unique_ptr<ResultWriter> ResultWriter::create(format_t format, FILE* fp, const VlinkConfig* config) {
+    std::unique_ptr<ResultWriter> writer;
+    switch(format) {
+        case Csv:
+            writer = std::make_unique<CsvResultWriter>(fp);
+            break;
+        case Jsonl:
+            writer = std::make_unique<JsonlResultWriter>(fp);
+            break;
+        case Bin:
+            writer = std::make_unique<BinResultWriter>(fp, config->linkRate);
+            break;
+    }
+    if(writer->failed()) {
+        return nullptr;
+    }
+    return writer;
+}
+
+// delays of dest in us
+static void delaysUs(const Vnode* dest, int64_t& dmin, int64_t& dmax, int64_t& jit) {
+    VlinkConfig* config = dest->vl->config;
+    dmin = static_cast<int64_t>(floor(1000. * config->linkByte2ms(dest->e2e.dmin())));
+    dmax = static_cast<int64_t>(ceil(1000. * config->linkByte2ms(dest->e2e.dmax())));
+    jit = static_cast<int64_t>(ceil(1000. * config->linkByte2ms(dest->e2e.jit())));
+}
+
+CsvResultWriter::CsvResultWriter(FILE* fp) : ResultWriter(fp) {
+    fprintf(fp, "vl,dest,minDelay,maxDelay,maxJit\n");
+}
+
+void CsvResultWriter::write(const Vnode* dest) {
+    int64_t dmin, dmax, jit;
+    delaysUs(dest, dmin, dmax, jit);
+    fprintf(fp, "%d,%d,%ld,%ld,%ld\n", dest->vl->id, dest->device->id, dmin, dmax, jit);
+}
+
+void JsonlResultWriter::write(const Vnode* dest) {
+    int64_t dmin, dmax, jit;
+    delaysUs(dest, dmin, dmax, jit);
+    fprintf(fp, "{\"vl\":%d,\"dest\":%d,\"minDelay\":%ld,\"maxDelay\":%ld,\"maxJit\":%ld}\n",
+            dest->vl->id, dest->device->id, dmin, dmax, jit);
+}
+
+BinResultWriter::BinResultWriter(FILE* fp, int64_t linkRate) : ResultWriter(fp) {
+    BinResultHeader header = {};
+    memcpy(header.magic, binResultMagic, sizeof(binResultMagic));
+    header.version = binResultVersion;
+    header.linkRate = linkRate;
+    fwrite(&header, sizeof(header), 1, fp);
+}
+
+void BinResultWriter::write(const Vnode* dest) {
+    BinResult res = {dest->vl->id, dest->device->id, dest->e2e.dmin(), dest->e2e.dmax(), dest->e2e.jit()};
+    fwrite(&res, sizeof(res), 1, fp);
+}
@@ -0,0 +1,72 @@
+#pragma once
+#ifndef DELAYTOOL_RESULTWRITER_H
+#define DELAYTOOL_RESULTWRITER_H
+
+#include <cstdio>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "algo.h"
+
+// writers of e2e delays only (without the input network), one record per VL destination:
+// VL id, destination device id, min delay, max delay and jitter.
+// csv and jsonl have delays in us (min delay rounded down, max delay and jitter rounded up, as in xml output),
+// bin has a BinResultHeader followed by BinResult records with exact delays in link-bytes
+class ResultWriter : public ResultSink
+{
+public:
+    enum format_t {Csv, Jsonl, Bin};
+
+    // nullptr if header can't be written
+    static std::unique_ptr<ResultWriter> create(format_t format, FILE* fp, const VlinkConfig* config);
+
+    explicit ResultWriter(FILE* fp) : fp(fp) {}
+
+    bool failed() const { return ferror(fp) != 0; }
+
+protected:
+    FILE* fp;
+};
+
+constexpr char binResultMagic[4] = {'D', 'T', 'R', 'S'};
+constexpr uint32_t binResultVersion = 1;
+
+struct BinResultHeader {
+    char magic[4];
+    uint32_t version;
+    int64_t linkRate; // in bytes/ms, delay in ms = delay in link-bytes / linkRate
+};
+
+struct BinResult {
+    int32_t vl;
+    int32_t dest;
+    int64_t dmin;
+    int64_t dmax;
+    int64_t jit;
+};
+
+class CsvResultWriter : public ResultWriter
+{
+public:
+    explicit CsvResultWriter(FILE* fp);
+
+    void write(const Vnode* dest) override;
+};
+
+class JsonlResultWriter : public ResultWriter
+{
+public:
+    explicit JsonlResultWriter(FILE* fp) : ResultWriter(fp) {}
+
+    void write(const Vnode* dest) override;
+};
+
+class BinResultWriter : public ResultWriter
+{
+public:
+    BinResultWriter(FILE* fp, int64_t linkRate);
+
+    void write(const Vnode* dest) override;
+};
+
+#endif //DELAYTOOL_RESULTWRITER_H
@@ -0,0 +1,129 @@
+#include "scheduler.h"
+
+void WorkStealingDeque::push(DelayTask* task) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push_back(task);
+}
+
+DelayTask* WorkStealingDeque::pop() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(tasks.empty()) {
+        return nullptr;
+    }
+    auto task = tasks.back();
+    tasks.pop_back();
+    return task;
+}
+
+DelayTask* WorkStealingDeque::steal() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(tasks.empty()) {
+        return nullptr;
+    }
+    auto task = tasks.front();
+    tasks.pop_front();
+    return task;
+}
+
+DataflowScheduler::DataflowScheduler(const TaskGraph& graph, const std::vector<DelayTask*>& allTasks,
+                                     ThreadPool& pool)
+    : graph(graph), allTasks(allTasks), pool(pool), n_pending(0), n_queued(0)
+{
+    for(int i = 0; i < pool.size(); i++) {
+        deques.push_back(std::make_unique<WorkStealingDeque>());
+    }
+}
+
+Error DataflowScheduler::run(const std::vector<DelayTask*>& tasks) {
+    if(tasks.empty()) {
+        return Error::Success;
+    }
+    runPos.assign(graph.size(), -1);
+    for(size_t i = 0; i < tasks.size(); i++) {
+        assert(tasks[i]->index >= 0 && allTasks[tasks[i]->index] == tasks[i]);
+        runPos[tasks[i]->index] = static_cast<int>(i);
+    }
+    errors.clear();
+    errors.resize(tasks.size());
+
+    // count input tasks of the same run, and distribute initially ready tasks between workers
+    for(auto delayTask: tasks) {
+        int n_unresolved = 0;
+        for(int j: graph.inputsOf(delayTask->index)) {
+            if(runPos[j] >= 0) {
+                n_unresolved++;
+            }
+        }
+        delayTask->n_unresolved = n_unresolved;
+    }
+    size_t n_ready = 0;
+    for(auto delayTask: tasks) {
+        if(delayTask->n_unresolved == 0) {
+            deques[n_ready % deques.size()]->push(delayTask);
+            n_ready++;
+        }
+    }
+    assert(n_ready > 0);
+    n_pending = n_ready;
+    n_queued = n_ready;
+
+    pool.parallelFor(deques.size(), [this](size_t worker) { workerLoop(worker); });
+
+    for(auto& err: errors) {
+        if(err) {
+            return err;
+        }
+    }
+    return Error::Success;
+}
+
+DelayTask* DataflowScheduler::nextTask(size_t worker) {
+    auto task = deques[worker]->pop();
+    for(size_t i = 1; task == nullptr && i < deques.size(); i++) {
+        task = deques[(worker + i) % deques.size()]->steal();
+    }
+    if(task != nullptr) {
+        n_queued--;
+    }
+    return task;
+}
+
+void DataflowScheduler::push(size_t worker, DelayTask* task) {
+    deques[worker]->push(task);
+    {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        n_queued++;
+    }
+    idle.notify_one();
+}
+
+void DataflowScheduler::workerLoop(size_t worker) {
+    while(n_pending > 0) {
+        auto delayTask = nextTask(worker);
+        if(delayTask == nullptr) {
+            std::unique_lock<std::mutex> lock(idleMutex);
+            idle.wait(lock, [this] { return n_pending == 0 || n_queued > 0; });
+            continue;
+        }
+        Error err = delayTask->calc_delay_max();
+        if(err) {
+            errors[runPos[delayTask->index]] = std::move(err);
+        } else {
+            for(int j: graph.outputsOf(delayTask->index)) {
+                if(runPos[j] >= 0 && --allTasks[j]->n_unresolved == 0) {
+                    // count the new ready task before the finished one is uncounted
+                    n_pending++;
+                    push(worker, allTasks[j]);
+                }
+            }
+        }
+        bool finished;
+        {
+            std::lock_guard<std::mutex> lock(idleMutex);
+            finished = --n_pending == 0;
+        }
+        if(finished) {
+            idle.notify_all();
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+#ifndef DELAYTOOL_SCHEDULER_H
+#define DELAYTOOL_SCHEDULER_H
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+
+#include "algo.h"
+#include "threadpool.h"
+
+// double-ended queue of ready tasks owned by one worker:
+// the owner pushes and pops at the back, other workers steal from the front
+class WorkStealingDeque
+{
+public:
+    void push(DelayTask* task);
+
+    DelayTask* pop(); // nullptr if empty
+
+    DelayTask* steal(); // nullptr if empty
+
+private:
+    std::mutex mutex;
+    std::deque<DelayTask*> tasks;
+};
+
+// calculates max delays of tasks in dataflow order: a task becomes ready when all of its
+// input tasks of the same run are calculated, ready tasks are executed by pool workers
+class DataflowScheduler
+{
+public:
+    // graph and tasks are config->taskGraph and config->tasks
+    DataflowScheduler(const TaskGraph& graph, const std::vector<DelayTask*>& allTasks, ThreadPool& pool);
+
+    // tasks must be closed under inputs (i.e. inputs of each task are either in tasks or already calculated)
+    // and have no cyclic dependencies between them.
+    // returns the error of the first failed task in tasks order, consumers of failed tasks are not calculated
+    Error run(const std::vector<DelayTask*>& tasks);
+
+private:
+    const TaskGraph& graph;
+    const std::vector<DelayTask*>& allTasks;
+    ThreadPool& pool;
+    std::vector<std::unique_ptr<WorkStealingDeque>> deques;
+    std::vector<int> runPos; // task index -> position in tasks of current run, or -1
+    std::vector<Error> errors; // by position in tasks of current run
+    std::atomic<size_t> n_pending; // tasks which are ready or being calculated
+    std::atomic<size_t> n_queued; // ready tasks in deques
+    // workers without tasks wait for a new ready task or the end of the run
+    std::mutex idleMutex;
+    std::condition_variable idle;
+
+    void workerLoop(size_t worker);
+
+    DelayTask* nextTask(size_t worker);
+
+    void push(size_t worker, DelayTask* task);
+};
+
+#endif //DELAYTOOL_SCHEDULER_H
@@ -0,0 +1,243 @@
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "server.h"
+#include "configio.h"
+#include "configbin.h"
+#include "resultwriter.h"
+
+static std::string errorStatus(const std::string& message) {
+    std::string res = "{\"ok\":false,\"error\":\"";
+    for(char c: message) {
+        if(c == '"' || c == '\\') {
+            res += '\\';
+        }
+        res += c == '\n' ? ' ' : c;
+    }
+    return res + "\"}";
+}
+
+// comma separated numbers
+static std::vector<int> parseInts(const std::string& str) {
+    std::vector<int> res;
+    std::stringstream ss(str);
+    std::string item;
+    while(std::getline(ss, item, ',')) {
+        size_t pos;
+        res.push_back(std::stoi(item, &pos));
+        if(pos != item.size()) {
+            throw std::invalid_argument(item);
+        }
+    }
+    return res;
+}
+
+bool AnalysisServer::run(const std::string& socketPath) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if(socketPath.size() >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "error: socket path is too long: %s\n", socketPath.c_str());
+        return false;
+    }
+    strcpy(addr.sun_path, socketPath.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socketPath.c_str());
+    if(fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+        fprintf(stderr, "error: can't listen on socket %s: %s\n", socketPath.c_str(), strerror(errno));
+        if(fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    // a client may disconnect before reading its response
+    signal(SIGPIPE, SIG_IGN);
+    printf("listening on %s\n", socketPath.c_str());
+    fflush(stdout);
+
+    bool running = true;
+    while(running) {
+        int client = accept(fd, nullptr, nullptr);
+        if(client < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "error: can't accept connection: %s\n", strerror(errno));
+            break;
+        }
+        FILE* in = fdopen(client, "r");
+        FILE* out = fdopen(dup(client), "w");
+        char* buf = nullptr;
+        size_t bufSize = 0;
+        ssize_t n;
+        while(running && (n = getline(&buf, &bufSize, in)) > 0) {
+            std::string line(buf, n);
+            while(!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+                line.pop_back();
+            }
+            running = handle(line, out);
+            fflush(out);
+        }
+        free(buf);
+        fclose(in);
+        fclose(out);
+    }
+    close(fd);
+    unlink(socketPath.c_str());
+    return true;
+}
+
+bool AnalysisServer::handle(const std::string& line, FILE* fp) {
+    std::stringstream ss(line);
+    std::string command;
+    std::vector<std::string> args;
+    ss >> command;
+    for(std::string arg; ss >> arg;) {
+        args.push_back(arg);
+    }
+    if(command.empty()) {
+        return true;
+    }
+
+    std::string status;
+    try {
+        if(command == "shutdown") {
+            fprintf(fp, "{\"ok\":true}\n");
+            return false;
+        } else if(command == "load") {
+            // the rest of the line, file name may contain spaces
+            size_t begin = line.find_first_not_of(" \t", line.find("load") + 4);
+            status = begin == std::string::npos ? errorStatus("no file name") : load(line.substr(begin));
+        } else if(config == nullptr) {
+            status = errorStatus("no config is loaded");
+        } else if(command == "evaluate") {
+            auto t1 = std::chrono::steady_clock::now();
+            Error err = analysis->analyze();
+            status = calculated(err, std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count());
+        } else if(command == "add" || command == "modify" || command == "remove") {
+            status = edit(command, args);
+        } else if(command == "e2e" || command == "dump") {
+            if(!calcError.empty()) {
+                status = errorStatus("delays are not calculated: " + calcError);
+            } else if(command == "e2e") {
+                Vnode* dest = nullptr;
+                if(args.size() == 2) {
+                    int vlId = std::stoi(args[0]);
+                    int destId = std::stoi(args[1]);
+                    auto vl = config->vlinks.find(vlId);
+                    if(vl != config->vlinks.end() && vl->second->dst.count(destId) > 0) {
+                        dest = vl->second->dst.at(destId);
+                    }
+                }
+                if(dest != nullptr) {
+                    JsonlResultWriter(fp).write(dest);
+                    status = "{\"ok\":true}";
+                } else {
+                    status = errorStatus("no such VL and destination");
+                }
+            } else {
+                JsonlResultWriter writer(fp);
+                size_t n = 0;
+                for(auto vl: config->getAllVlinks()) {
+                    for(auto [_, dest]: vl->dst) {
+                        writer.write(dest);
+                        n++;
+                    }
+                }
+                status = "{\"ok\":true,\"results\":" + std::to_string(n) + "}";
+            }
+        } else {
+            status = errorStatus("unknown request " + command);
+        }
+    } catch(std::invalid_argument& e) {
+        status = errorStatus("bad arguments of " + command);
+    } catch(std::out_of_range& e) {
+        status = errorStatus("bad arguments of " + command);
+    } catch(std::exception& e) {
+        calcError = std::string("exception: ") + e.what();
+        status = errorStatus(calcError);
+    }
+    fprintf(fp, "%s\n", status.c_str());
+    return true;
+}
+
+std::string AnalysisServer::load(const std::string& fileName) {
+    MappedFile input(fileName);
+    if(!input.ok()) {
+        return errorStatus("can't load input file: " + fileName);
+    }
+    const auto& a = options.analysis;
+    auto text = input.text();
+    VlinkConfigOwn loaded = isBinConfig(text)
+            ? fromBin(text, options.scheme, options.jitDefault, a.forceLinkRate, options.loadFactor,
+                      a.bpMaxIter, a.cyclicMaxIter, options.nFabrics, a.nQueues)
+            : fromXmlText(text, options.scheme, options.jitDefault, a.forceLinkRate, options.loadFactor,
+                          a.bpMaxIter, a.cyclicMaxIter, options.nFabrics, a.nQueues);
+    if(loaded == nullptr) {
+        return errorStatus("can't read config from " + fileName);
+    }
+    if(!bwCorrect(loaded->bwUsage())) {
+        return errorStatus("bandwidth usage is more than 100%");
+    }
+    loaded->bpSolver = a.bpSolver;
+    loaded->cyclicSolver = a.cyclicSolver;
+    loaded->cyclicWiden = a.cyclicWiden;
+    loaded->cioqMapper = a.cioqMapper;
+    loaded->n_threads = std::max(a.n_threads, 1);
+    analysis.reset();
+    config = std::move(loaded);
+    analysis = std::make_unique<IncrementalAnalysis>(config.get(), options.loadFactor, options.jitDefault);
+
+    auto t1 = std::chrono::steady_clock::now();
+    Error err = analysis->analyze();
+    return calculated(err, std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count());
+}
+
+std::string AnalysisServer::calculated(Error err, double time) {
+    if(err) {
+        calcError = err.TypeString() + ", " + err.Verbose();
+        return errorStatus("can't calculate delays: " + calcError);
+    }
+    calcError.clear();
+    char buf[128];
+    snprintf(buf, sizeof(buf), "{\"ok\":true,\"vlinks\":%zu,\"recalculated\":%zu,\"time\":%g}",
+             config->vlinks.size(), analysis->lastRecalculated(), time);
+    return buf;
+}
+
+std::string AnalysisServer::edit(const std::string& command, const std::vector<std::string>& args) {
+    std::string reason;
+    if(command == "remove") {
+        if(args.size() != 1) {
+            return errorStatus("usage: remove <id>");
+        }
+        reason = analysis->removeVlink(std::stoi(args[0]));
+    } else {
+        if(args.size() != 5 && args.size() != 6) {
+            return errorStatus("usage: " + command + " <id> <source> <bag> <lmax> <path>[;<path>...] [<jitStart>]");
+        }
+        VlinkSpec spec;
+        spec.id = std::stoi(args[0]);
+        spec.srcId = std::stoi(args[1]);
+        spec.bag = std::stoi(args[2]);
+        spec.lmax = std::stoi(args[3]);
+        std::stringstream paths(args[4]);
+        for(std::string path; std::getline(paths, path, ';');) {
+            spec.paths.push_back(parseInts(path));
+        }
+        if(args.size() == 6) {
+            spec.jitStart = std::stod(args[5]);
+        }
+        reason = command == "add" ? analysis->addVlink(spec) : analysis->modifyVlink(spec);
+    }
+    if(!reason.empty()) {
+        return errorStatus(reason);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    Error err = analysis->update();
+    return calculated(err, std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count());
+}
@@ -0,0 +1,61 @@
+#pragma once
+#ifndef DELAYTOOL_SERVER_H
+#define DELAYTOOL_SERVER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "algo.h"
+#include "batch.h"
+#include "incremental.h"
+#include "configio.h"
+
+// parameters configs are loaded and analyzed with
+struct ServerOptions {
+    std::string scheme = "CIOQ";
+    int nFabrics = nFabricsDefault;
+    double loadFactor = 1.;
+    double jitDefault = jitStartDefault;
+    BatchOptions analysis;
+};
+
+// keeps a loaded config with its delay tasks and delays in memory and answers requests read from
+// a unix domain socket, one text line per request, clients are served one after another.
+// every request gets zero or more result lines and then one status line, all of them are json:
+//   load <file>                   load xml or binary config and calculate all delays
+//   evaluate                      calculate all delays of the loaded config again
+//   add <id> <source> <bag> <lmax> <path>[;<path>...] [<jitStart>]
+//   modify <id> <source> <bag> <lmax> <path>[;<path>...] [<jitStart>]
+//                                 add or replace VL (paths are comma separated input port ids) and
+//                                 recalculate delays affected by it
+//   remove <id>                   remove VL and recalculate delays affected by it
+//   e2e <vl> <dest>               delays of VL to destination, as in jsonl output
+//   dump                          delays of all VLs to all destinations, as in jsonl output
+//   shutdown                      stop the server
+// status line is {"ok":true,...} with request specific values or {"ok":false,"error":"..."}
+class AnalysisServer
+{
+public:
+    explicit AnalysisServer(const ServerOptions& options) : options(options) {}
+
+    // serves requests until shutdown, false if the socket can't be created
+    bool run(const std::string& socketPath);
+
+    // handles one request line writing the response to fp, false after shutdown
+    bool handle(const std::string& line, FILE* fp);
+
+private:
+    const ServerOptions options;
+    VlinkConfigOwn config;
+    std::unique_ptr<IncrementalAnalysis> analysis;
+    std::string calcError; // why delays of config are not calculated, empty if they are
+
+    std::string load(const std::string& fileName);
+
+    // status values of a calculation, or an error
+    std::string calculated(Error err, double time);
+
+    std::string edit(const std::string& command, const std::vector<std::string>& args);
+};
+
+#endif //DELAYTOOL_SERVER_H
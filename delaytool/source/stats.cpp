@@ -0,0 +1,65 @@
+#include <ctime>
+#include <sys/resource.h>
+#include "stats.h"
+
+static const char* phaseNames[AnalysisStats::n_phases] = {
+        "parse", "buildTables", "buildDelayTasks", "buildTasksOrder", "acyclic", "cyclic"
+};
+
+static double clockSeconds(clockid_t clock) {
+    timespec ts = {};
+    clock_gettime(clock, &ts);
+    return static_cast<double>(ts.tv_sec) + ts.tv_nsec * 1e-9;
+}
+
+void AnalysisStats::addCandidatePoints(uint64_t delayFuncPoints, uint64_t delayFuncRemPoints) {
+    qrtaCalcs.fetch_add(1, std::memory_order_relaxed);
+    delayFuncEvals.fetch_add(delayFuncPoints, std::memory_order_relaxed);
+    delayFuncRemEvals.fetch_add(delayFuncRemPoints, std::memory_order_relaxed);
+    uint64_t points = delayFuncPoints + delayFuncRemPoints;
+    uint64_t maxPoints = maxCandidatePoints.load(std::memory_order_relaxed);
+    while(points > maxPoints && !maxCandidatePoints.compare_exchange_weak(maxPoints, points)) {}
+}
+
+void AnalysisStats::writeJson(FILE* fp) const {
+    fprintf(fp, "{\"phases\":{");
+    for(int i = 0; i < n_phases; i++) {
+        fprintf(fp, "%s\"%s\":{\"wall\":%.6f,\"cpu\":%.6f}", i > 0 ? "," : "", phaseNames[i], wall[i], cpu[i]);
+    }
+    uint64_t calcs = qrtaCalcs;
+    uint64_t points = delayFuncEvals + delayFuncRemEvals;
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(fp, "},\"counters\":{\"bpIterations\":%lu,\"qrtaCalcs\":%lu,\"delayFuncEvals\":%lu,"
+                "\"delayFuncRemEvals\":%lu,\"candidatePointsMean\":%.3f,\"candidatePointsMax\":%lu,"
+                "\"cyclicIterations\":%lu},\"peakRssKb\":%ld}\n",
+            bpIterations.load(), calcs, delayFuncEvals.load(), delayFuncRemEvals.load(),
+            calcs > 0 ? static_cast<double>(points) / calcs : 0., maxCandidatePoints.load(),
+            cyclicIterations, usage.ru_maxrss);
+}
+
+PhaseTimer::PhaseTimer(AnalysisStats* stats, AnalysisStats::phase_t phase)
+    : stats(stats), phase(phase),
+      wall0(stats != nullptr ? clockSeconds(CLOCK_MONOTONIC) : 0),
+      cpu0(stats != nullptr ? clockSeconds(CLOCK_PROCESS_CPUTIME_ID) : 0) {}
+
+void PhaseTimer::stop() {
+    if(stats != nullptr) {
+        stats->wall[phase] += clockSeconds(CLOCK_MONOTONIC) - wall0;
+        stats->cpu[phase] += clockSeconds(CLOCK_PROCESS_CPUTIME_ID) - cpu0;
+        stats = nullptr;
+    }
+}
+
+StatsFileWriter::~StatsFileWriter() {
+    if(stats == nullptr || fileName.empty()) {
+        return;
+    }
+    FILE* fp = fopen(fileName.c_str(), "w");
+    if(fp == nullptr) {
+        fprintf(stderr, "error: can't open stats file: %s\n", fileName.c_str());
+        return;
+    }
+    stats->writeJson(fp);
+    fclose(fp);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#ifndef DELAYTOOL_STATS_H
+#define DELAYTOOL_STATS_H
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <atomic>
+
+// wall and CPU (of the whole process) time of analysis phases and counters of QRTA calculations,
+// collected into VlinkConfig::stats if it is set. counters may be updated from many threads
+class AnalysisStats
+{
+public:
+    enum phase_t {Parse, BuildTables, BuildDelayTasks, BuildTasksOrder, Acyclic, Cyclic, n_phases};
+
+    double wall[n_phases] = {};
+    double cpu[n_phases] = {};
+
+    std::atomic<uint64_t> bpIterations{0}; // iterations of busy period calculation
+    std::atomic<uint64_t> qrtaCalcs{0}; // delays of VL branches calculated by QRTA
+    std::atomic<uint64_t> delayFuncEvals{0}; // points where delayFunc is evaluated
+    std::atomic<uint64_t> delayFuncRemEvals{0}; // points where delayFuncRem is evaluated
+    std::atomic<uint64_t> maxCandidatePoints{0}; // maximum number of both points in one QRTA calculation
+    uint64_t cyclicIterations = 0; // maximum number of calculations of a cyclic task
+
+    // adds points of one QRTA calculation
+    void addCandidatePoints(uint64_t delayFuncPoints, uint64_t delayFuncRemPoints);
+
+    // json object with times in seconds and peak resident set size of the process in KB
+    void writeJson(FILE* fp) const;
+};
+
+// measures time from construction to stop() or destruction and adds it to a phase, nothing if stats is nullptr
+class PhaseTimer
+{
+public:
+    PhaseTimer(AnalysisStats* stats, AnalysisStats::phase_t phase);
+
+    ~PhaseTimer() { stop(); }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    void stop();
+
+private:
+    AnalysisStats* stats;
+    AnalysisStats::phase_t phase;
+    double wall0;
+    double cpu0;
+};
+
+// writes stats as json to fileName when destroyed, so they are written however the analysis ends
+class StatsFileWriter
+{
+public:
+    StatsFileWriter(const AnalysisStats* stats, std::string fileName) : stats(stats), fileName(std::move(fileName)) {}
+
+    ~StatsFileWriter();
+
+private:
+    const AnalysisStats* stats;
+    std::string fileName;
+};
+
+#endif //DELAYTOOL_STATS_H
@@ -0,0 +1,71 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(int n_threads)
+    : job(nullptr), jobSize(0), jobNext(0), generation(0), n_running(0), stop(false)
+{
+    for(int i = 1; i < n_threads; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    cvStart.notify_all();
+    for(auto& worker: workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t)>& func) {
+    if(n == 0) {
+        return;
+    }
+    if(workers.empty() || n == 1) {
+        for(size_t i = 0; i < n; i++) {
+            func(i);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &func;
+        jobSize = n;
+        jobNext = 0;
+        n_running = static_cast<int>(workers.size());
+        generation++;
+    }
+    cvStart.notify_all();
+    runJob();
+    std::unique_lock<std::mutex> lock(mutex);
+    cvDone.wait(lock, [this]() { return n_running == 0; });
+    job = nullptr;
+}
+
+void ThreadPool::runJob() {
+    for(size_t i = jobNext++; i < jobSize; i = jobNext++) {
+        (*job)(i);
+    }
+}
+
+void ThreadPool::workerLoop() {
+    uint64_t seen = 0;
+    while(true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cvStart.wait(lock, [&]() { return stop || generation != seen; });
+            if(stop) {
+                return;
+            }
+            seen = generation;
+        }
+        runJob();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            n_running--;
+        }
+        cvDone.notify_one();
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+#ifndef DELAYTOOL_THREADPOOL_H
+#define DELAYTOOL_THREADPOOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// fixed set of worker threads executing parallel loops.
+// the calling thread takes part in each loop too, so n_threads == 1 means no worker threads.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int n_threads);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return static_cast<int>(workers.size()) + 1; }
+
+    // call func(i) for all i in [0, n) in any order and any threads, return when all calls are finished
+    void parallelFor(size_t n, const std::function<void(size_t)>& func);
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable cvStart;
+    std::condition_variable cvDone;
+
+    // current loop, changed only when all workers are idle
+    const std::function<void(size_t)>* job;
+    size_t jobSize;
+    std::atomic<size_t> jobNext;
+    uint64_t generation; // number of started loops
+    int n_running; // workers which are still in the current loop
+    bool stop;
+
+    void workerLoop();
+
+    void runJob();
+};
+
+#endif //DELAYTOOL_THREADPOOL_H
@@ -0,0 +1,150 @@
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include "xmlscanner.h"
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool isNameChar(char c) {
+    return !isSpace(c) && c != '/' && c != '>' && c != '=' && c != '<' && c != '"' && c != '\'';
+}
+
+bool XmlScanner::fail() {
+    error = true;
+    tagBegin = pos;
+    return false;
+}
+
+bool XmlScanner::skipUntil(std::string_view end) {
+    auto found = text.find(end, pos);
+    if(found == std::string_view::npos) {
+        return fail();
+    }
+    pos = found + end.size();
+    return true;
+}
+
+void XmlScanner::skipSpaces() {
+    while(pos < text.size() && isSpace(text[pos])) {
+        pos++;
+    }
+}
+
+std::string_view XmlScanner::scanName() {
+    size_t start = pos;
+    while(pos < text.size() && isNameChar(text[pos])) {
+        pos++;
+    }
+    return text.substr(start, pos - start);
+}
+
+bool XmlScanner::next() {
+    if(error) {
+        return false;
+    }
+    while(true) {
+        pos = text.find('<', pos);
+        if(pos == std::string_view::npos) {
+            pos = text.size();
+            return false;
+        }
+        auto rest = text.substr(pos);
+        if(rest.substr(0, 4) == "<!--") {
+            if(!skipUntil("-->")) {
+                return false;
+            }
+        } else if(rest.substr(0, 9) == "<![CDATA[") {
+            if(!skipUntil("]]>")) {
+                return false;
+            }
+        } else if(rest.substr(0, 2) == "<?") {
+            if(!skipUntil("?>")) {
+                return false;
+            }
+        } else if(rest.substr(0, 2) == "<!") {
+            if(!skipUntil(">")) {
+                return false;
+            }
+        } else {
+            break;
+        }
+    }
+
+    tagBegin = pos;
+    pos++;
+    isEnd = pos < text.size() && text[pos] == '/';
+    if(isEnd) {
+        pos++;
+    }
+    isEmpty = false;
+    attributes.clear();
+    name = scanName();
+    if(name.empty()) {
+        return fail();
+    }
+    attributesEnd = pos;
+    while(true) {
+        skipSpaces();
+        if(pos >= text.size()) {
+            return fail();
+        }
+        if(text[pos] == '>') {
+            pos++;
+            break;
+        }
+        if(!isEnd && text.substr(pos, 2) == "/>") {
+            isEmpty = true;
+            pos += 2;
+            break;
+        }
+        if(isEnd) {
+            return fail();
+        }
+        Attribute attr;
+        attr.name = scanName();
+        skipSpaces();
+        if(attr.name.empty() || pos >= text.size() || text[pos] != '=') {
+            return fail();
+        }
+        pos++;
+        skipSpaces();
+        if(pos >= text.size() || (text[pos] != '"' && text[pos] != '\'')) {
+            return fail();
+        }
+        char quote = text[pos];
+        size_t valueBegin = pos + 1;
+        size_t valueEnd = text.find(quote, valueBegin);
+        if(valueEnd == std::string_view::npos) {
+            return fail();
+        }
+        attr.value = text.substr(valueBegin, valueEnd - valueBegin);
+        attributes.push_back(attr);
+        pos = valueEnd + 1;
+        attributesEnd = pos;
+    }
+    tagEnd = pos;
+    return true;
+}
+
+std::string_view XmlScanner::attribute(std::string_view attrName) const {
+    for(const auto& attr: attributes) {
+        if(attr.name == attrName) {
+            return attr.value;
+        }
+    }
+    return {};
+}
+
+std::string_view XmlScanner::requireAttribute(std::string_view attrName) const {
+    auto value = attribute(attrName);
+    if(value.data() == nullptr) {
+        throw std::runtime_error("no attribute " + std::string(attrName) + " in element " + std::string(name));
+    }
+    return value;
+}
+
+bool isInside(const std::vector<std::string_view>& stack, std::initializer_list<std::string_view> path) {
+    return stack.size() == path.size() && std::equal(path.begin(), path.end(), stack.begin());
+}
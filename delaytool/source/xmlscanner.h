@@ -0,0 +1,58 @@
+#pragma once
+#ifndef DELAYTOOL_XMLSCANNER_H
+#define DELAYTOOL_XMLSCANNER_H
+
+#include <string_view>
+#include <vector>
+#include <initializer_list>
+
+// pull scanner over xml text, reports element tags one by one without building a document.
+// text, comments, declarations and CDATA are skipped, entities in attribute values are not decoded.
+// all string views point into the scanned text
+class XmlScanner
+{
+public:
+    struct Attribute {
+        std::string_view name;
+        std::string_view value; // without quotes
+    };
+
+    explicit XmlScanner(std::string_view text) : text(text), pos(0), error(false) {}
+
+    // move to the next start or end tag, false at the end of text or on error
+    bool next();
+
+    bool failed() const { return error; }
+
+    // offset of the current tag in text or of the error
+    size_t offset() const { return tagBegin; }
+
+    // value of attribute of the current start tag, empty view with nullptr data if there is none
+    std::string_view attribute(std::string_view attrName) const;
+
+    // same as attribute, throws std::runtime_error if there is none
+    std::string_view requireAttribute(std::string_view attrName) const;
+
+    std::string_view name;
+    bool isEnd; // </name>
+    bool isEmpty; // <name ... />
+    std::vector<Attribute> attributes;
+    size_t tagBegin; // offset of '<'
+    size_t attributesEnd; // offset after the last attribute (or the name)
+    size_t tagEnd; // offset after '>'
+
+private:
+    bool skipUntil(std::string_view end);
+    void skipSpaces();
+    std::string_view scanName();
+    bool fail();
+
+    std::string_view text;
+    size_t pos;
+    bool error;
+};
+
+// true if names of open elements (from the root one) in stack are path
+bool isInside(const std::vector<std::string_view>& stack, std::initializer_list<std::string_view> path);
+
+#endif //DELAYTOOL_XMLSCANNER_H